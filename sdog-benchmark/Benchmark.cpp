@@ -0,0 +1,342 @@
+#include "Benchmark.h"
+
+#include "CachedOperations.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+
+Benchmark::Benchmark(const BenchmarkConfig& config) :
+	config(config)
+{
+	if (this->config.variants.empty()) {
+		this->config.variants = variantNames();
+	}
+	this->config.batchSize = std::max(this->config.batchSize, (size_t)1);
+	this->config.repetitions = std::max(this->config.repetitions, 1);
+}
+
+
+const std::vector<std::string>& Benchmark::variantNames() {
+
+	static const std::vector<std::string> names = {
+		"efficient",
+		"efficientVol",
+		"efficientMap",
+		"simple",
+		"simpleVol",
+		"simpleMap",
+		"efficientQuantized",
+		"efficientVolCached"
+	};
+	return names;
+}
+
+
+Benchmark::Variant Benchmark::makeVariant(const std::string& name, size_t cacheBudget) {
+
+	Variant v;
+	v.name = name;
+
+	if (name == "efficient") {
+		v.ops = std::make_unique<EfficientOperations>();
+	}
+	else if (name == "efficientVol") {
+		v.ops = std::make_unique<ModifiedEfficient>();
+	}
+	else if (name == "efficientMap") {
+		v.ops = std::make_unique<ModifiedEfficient>(2.0, 1.45);
+	}
+	else if (name == "simple") {
+		v.ops = std::make_unique<SimpleOperations>();
+	}
+	else if (name == "simpleVol") {
+		v.ops = std::make_unique<SimpleOperations>(true);
+	}
+	else if (name == "simpleMap") {
+		v.ops = std::make_unique<SimpleOperations>(2.0, 1.45);
+	}
+	else if (name == "efficientQuantized") {
+		v.ops = std::make_unique<EfficientOperations>();
+		v.quantized = true;
+	}
+	else if (name == "efficientVolCached") {
+		v.inner = std::make_unique<ModifiedEfficient>();
+		v.ops = std::make_unique<CachedOperations>(v.inner.get(), cacheBudget);
+	}
+	return v;
+}
+
+
+std::vector<BenchmarkResult> Benchmark::run() {
+
+	// Same inputs for every variant so results are comparable
+	WorkloadGenerator generator(config.distribution, config.seed);
+	PointBuffer points;
+	generator.generate(config.n, points);
+
+	std::vector<QuantizedPoint> quantized;
+	for (size_t i = 0; i < points.size(); i++) {
+		quantized.push_back(QuantizedPoint(points[i]));
+	}
+
+	std::vector<Variant> variants;
+	for (const std::string& name : config.variants) {
+		Variant v = makeVariant(name, config.cacheBudget);
+		if (v.ops) {
+			variants.push_back(std::move(v));
+		}
+		else {
+			std::cerr << "unknown variant " << name << std::endl;
+		}
+	}
+
+	if (config.counters && !perf.isAvailable()) {
+		std::cerr << "hardware counters unavailable" << std::endl;
+	}
+
+	EfficientOperations efficient;
+	std::vector<BenchmarkResult> results;
+
+	for (int k = config.minK; k <= config.maxK; k++) {
+
+		std::vector<Index> indices(points.size());
+		for (size_t i = 0; i < points.size(); i++) {
+			indices[i] = efficient.pointToIndex(points[i], k);
+		}
+
+		for (unsigned int numThreads : config.threads) {
+			for (const Variant& v : variants) {
+
+				const IndexOperations* io = v.ops.get();
+
+				if (v.quantized) {
+					const EfficientOperations* eo = static_cast<const EfficientOperations*>(io);
+					results.push_back(measure(v, "PtoI", k, numThreads, quantized, [=](const QuantizedPoint& p) {
+						return eo->pointToIndex(p, k);
+					}));
+					continue;
+				}
+
+				// Points are read straight from the structure of arrays buffer
+				results.push_back(measure(v, "PtoI", k, numThreads, points, [=](const Point& p) {
+					return io->pointToIndex(p, k);
+				}));
+				results.push_back(measure(v, "ItoR", k, numThreads, indices, [=](Index i) {
+					return io->indexToRange(i);
+				}));
+			}
+		}
+	}
+	return results;
+}
+
+
+template <typename Inputs, typename Op>
+BenchmarkResult Benchmark::measure(const Variant& variant, const char* opName, int k, unsigned int numThreads,
+                                   const Inputs& inputs, Op op) {
+
+	// Per thread state below is sized by the thread count parallelFor will actually use
+	if (numThreads == 0) {
+		numThreads = defaultThreadCount();
+	}
+
+	BenchmarkResult result;
+	result.variant = variant.name;
+	result.workload = WorkloadGenerator::distributionName(config.distribution);
+	result.op = opName;
+	result.k = k;
+	result.threads = numThreads;
+	result.n = inputs.size();
+
+	CachedOperations* cache = dynamic_cast<CachedOperations*>(variant.ops.get());
+
+	// Throughput passes time the whole loop, clock reads stay out of the ns/op figure
+	auto pass = [&]() {
+		parallelFor(inputs.size(), numThreads, [&](size_t begin, size_t end, unsigned int) {
+			for (size_t i = begin; i < end; i++) {
+				doNotOptimize(op(inputs[i]));
+			}
+		});
+	};
+
+	// Latency pass times each batch separately for the percentiles
+	std::vector<std::vector<double>> threadSamples(numThreads);
+	auto latencyPass = [&]() {
+		parallelFor(inputs.size(), numThreads, [&](size_t begin, size_t end, unsigned int t) {
+
+			std::vector<double>& samples = threadSamples[t];
+			for (size_t b = begin; b < end; b += config.batchSize) {
+
+				size_t e = std::min(end, b + config.batchSize);
+
+				std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+				for (size_t i = b; i < e; i++) {
+					doNotOptimize(op(inputs[i]));
+				}
+				std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+				samples.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() / (e - b));
+			}
+		});
+	};
+
+	// Warm up caches and branch predictors
+	pass();
+	if (cache) {
+		cache->resetStats();
+	}
+
+	double totalSeconds = 0.0;
+	for (int rep = 0; rep < config.repetitions; rep++) {
+
+		if (config.counters) {
+			perf.start();
+		}
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		pass();
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+		if (config.counters) {
+			PerfSample s = perf.stop();
+			result.counters.valid = s.valid;
+			result.counters.cycles += s.cycles;
+			result.counters.instructions += s.instructions;
+			result.counters.cacheReferences += s.cacheReferences;
+			result.counters.cacheMisses += s.cacheMisses;
+		}
+		totalSeconds += std::chrono::duration<double>(t1 - t0).count();
+	}
+	result.counters.cycles /= config.repetitions;
+	result.counters.instructions /= config.repetitions;
+	result.counters.cacheReferences /= config.repetitions;
+	result.counters.cacheMisses /= config.repetitions;
+
+	latencyPass();
+
+	std::vector<double> samples;
+	for (const std::vector<double>& s : threadSamples) {
+		samples.insert(samples.end(), s.begin(), s.end());
+	}
+	std::sort(samples.begin(), samples.end());
+
+	auto percentile = [&](double q) {
+		return samples.empty() ? 0.0 : samples[std::min(samples.size() - 1, (size_t)(q * samples.size()))];
+	};
+
+	result.nsPerOp = totalSeconds * 1.0e9 / ((double)inputs.size() * config.repetitions);
+	result.p50 = percentile(0.50);
+	result.p99 = percentile(0.99);
+
+	// Only decoding goes through the cache
+	if (cache) {
+		CacheStats stats = cache->getStats();
+		if (stats.hits + stats.misses > 0) {
+			result.hitRate = stats.hitRate();
+		}
+	}
+	return result;
+}
+
+
+void Benchmark::printTable(const std::vector<BenchmarkResult>& results) {
+
+	std::cout << std::left << std::setw(20) << "variant" << std::setw(6) << "op" << std::setw(4) << "k" << std::setw(8) << "threads";
+	std::cout << std::right << std::setw(10) << "ns/op" << std::setw(10) << "p50" << std::setw(10) << "p99";
+	std::cout << std::setw(8) << "IPC" << std::setw(12) << "miss/op" << std::setw(8) << "hits" << std::endl;
+
+	std::cout << std::fixed << std::setprecision(2);
+	for (const BenchmarkResult& r : results) {
+
+		std::cout << std::left << std::setw(20) << r.variant << std::setw(6) << r.op << std::setw(4) << r.k << std::setw(8) << r.threads;
+		std::cout << std::right << std::setw(10) << r.nsPerOp << std::setw(10) << r.p50 << std::setw(10) << r.p99;
+		if (r.counters.valid) {
+			std::cout << std::setw(8) << r.counters.ipc() << std::setw(12) << r.counters.cacheMisses / (double)r.n;
+		}
+		else {
+			std::cout << std::setw(8) << "-" << std::setw(12) << "-";
+		}
+		if (r.hitRate >= 0.0) {
+			std::cout << std::setw(8) << r.hitRate;
+		}
+		else {
+			std::cout << std::setw(8) << "-";
+		}
+		std::cout << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+}
+
+
+bool Benchmark::writeJson(const std::vector<BenchmarkResult>& results, const std::string& fileName) {
+
+	std::ofstream out(fileName);
+	if (!out) {
+		return false;
+	}
+
+	out << "[" << std::endl;
+	for (size_t i = 0; i < results.size(); i++) {
+
+		const BenchmarkResult& r = results[i];
+		out << "  {\"variant\": \"" << r.variant << "\", \"workload\": \"" << r.workload << "\", \"op\": \"" << r.op << "\", \"k\": " << r.k;
+		out << ", \"threads\": " << r.threads << ", \"n\": " << r.n;
+		out << ", \"ns_per_op\": " << r.nsPerOp << ", \"p50\": " << r.p50 << ", \"p99\": " << r.p99;
+
+		if (r.counters.valid) {
+			out << ", \"cycles\": " << r.counters.cycles << ", \"instructions\": " << r.counters.instructions;
+			out << ", \"ipc\": " << r.counters.ipc();
+			out << ", \"cache_references\": " << r.counters.cacheReferences << ", \"cache_misses\": " << r.counters.cacheMisses;
+		}
+		else {
+			out << ", \"cycles\": null, \"instructions\": null, \"ipc\": null, \"cache_references\": null, \"cache_misses\": null";
+		}
+
+		if (r.hitRate >= 0.0) {
+			out << ", \"hit_rate\": " << r.hitRate;
+		}
+		else {
+			out << ", \"hit_rate\": null";
+		}
+		out << "}" << ((i + 1 < results.size()) ? "," : "") << std::endl;
+	}
+	out << "]" << std::endl;
+
+	return true;
+}
+
+
+bool Benchmark::writeCsv(const std::vector<BenchmarkResult>& results, const std::string& fileName) {
+
+	std::ofstream out(fileName);
+	if (!out) {
+		return false;
+	}
+
+	out << "variant,workload,op,k,threads,n,ns_per_op,p50,p99,cycles,instructions,ipc,cache_references,cache_misses,hit_rate" << std::endl;
+	for (const BenchmarkResult& r : results) {
+
+		out << r.variant << "," << r.workload << "," << r.op << "," << r.k << "," << r.threads << "," << r.n << ",";
+		out << r.nsPerOp << "," << r.p50 << "," << r.p99 << ",";
+
+		if (r.counters.valid) {
+			out << r.counters.cycles << "," << r.counters.instructions << "," << r.counters.ipc() << ",";
+			out << r.counters.cacheReferences << "," << r.counters.cacheMisses << ",";
+		}
+		else {
+			out << ",,,,,";
+		}
+
+		if (r.hitRate >= 0.0) {
+			out << r.hitRate;
+		}
+		out << std::endl;
+	}
+
+	return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "PerfCounters.h"
+
+#include "IndexOperations.h"
+#include "Workload.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// Keeps the compiler from removing a computation whose result is otherwise unused
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	const volatile char* volatile sink = &reinterpret_cast<const volatile char&>(value);
+	(void)sink;
+	_ReadWriteBarrier();
+#endif
+}
+
+
+struct BenchmarkConfig {
+	std::vector<std::string> variants;
+	int minK = 1;
+	int maxK = 21;
+	size_t n = 1000000;
+	std::vector<unsigned int> threads = { 1 };
+	int repetitions = 5;
+	size_t batchSize = 64;     // operations timed together for one latency sample
+	size_t cacheBudget = 64ull << 20;
+	Distribution distribution = Distribution::VOLUME_UNIFORM;
+	unsigned int seed = 1;
+	bool counters = true;
+};
+
+
+struct BenchmarkResult {
+	std::string variant;
+	std::string workload;
+	std::string op;
+	int k;
+	unsigned int threads;
+	size_t n;
+
+	double nsPerOp;            // wall time per operation, the inverse of throughput when threaded
+	double p50;                // per operation latency percentiles over batches
+	double p99;
+
+	PerfSample counters;       // average of one pass over the inputs
+	double hitRate = -1.0;     // only for cached variants
+};
+
+
+// Times every encoder and decoder variant for a range of levels and thread counts
+class Benchmark {
+
+public:
+	Benchmark(const BenchmarkConfig& config);
+
+	std::vector<BenchmarkResult> run();
+
+	static const std::vector<std::string>& variantNames();
+
+	static void printTable(const std::vector<BenchmarkResult>& results);
+	static bool writeJson(const std::vector<BenchmarkResult>& results, const std::string& fileName);
+	static bool writeCsv(const std::vector<BenchmarkResult>& results, const std::string& fileName);
+
+private:
+	struct Variant {
+		std::string name;
+		std::unique_ptr<IndexOperations> inner; // wrapped by ops for decorator variants
+		std::unique_ptr<IndexOperations> ops;
+		bool quantized = false;
+	};
+
+	BenchmarkConfig config;
+	PerfCounters perf;
+
+	static Variant makeVariant(const std::string& name, size_t cacheBudget);
+
+	// Inputs is any container with size() and operator[], a PointBuffer is read without converting it to points
+	template <typename Inputs, typename Op>
+	BenchmarkResult measure(const Variant& variant, const char* opName, int k, unsigned int numThreads,
+	                        const Inputs& inputs, Op op);
+};
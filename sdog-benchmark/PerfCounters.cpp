@@ -0,0 +1,148 @@
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+
+#ifdef __linux__
+
+// The first counter leads the group and the others follow it, a read of the leader returns all of them
+static int openCounter(uint64_t config, int groupFd) {
+
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = config;
+	attr.disabled = (groupFd == -1) ? 1 : 0;
+	attr.inherit = 1; // count worker threads started while enabled
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0);
+}
+
+
+PerfCounters::PerfCounters() {
+
+	for (int& fd : fds) {
+		fd = -1;
+	}
+	available = open();
+	close();
+}
+
+
+PerfCounters::~PerfCounters() {
+	close();
+}
+
+
+bool PerfCounters::open() {
+
+	const uint64_t configs[NUM_COUNTERS] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_REFERENCES,
+		PERF_COUNT_HW_CACHE_MISSES
+	};
+	for (int i = 0; i < NUM_COUNTERS; i++) {
+		fds[i] = openCounter(configs[i], (i == 0) ? -1 : fds[0]);
+		if (fds[i] < 0) {
+			close();
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void PerfCounters::close() {
+
+	// Followers are closed before the leader
+	for (int i = NUM_COUNTERS - 1; i >= 0; i--) {
+		if (fds[i] >= 0) {
+			::close(fds[i]);
+			fds[i] = -1;
+		}
+	}
+}
+
+
+bool PerfCounters::isAvailable() const {
+	return available;
+}
+
+
+void PerfCounters::start() {
+
+	close();
+	if (!available || !open()) {
+		return;
+	}
+	ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+
+PerfSample PerfCounters::stop() {
+
+	PerfSample sample;
+	if (fds[0] < 0) {
+		return sample;
+	}
+
+	// Layout of a PERF_FORMAT_GROUP read: the number of counters then their values in the order they were opened
+	struct {
+		uint64_t nr;
+		uint64_t values[NUM_COUNTERS];
+	} group;
+
+	ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	if (read(fds[0], &group, sizeof(group)) == sizeof(group) && group.nr == NUM_COUNTERS) {
+		sample.valid = true;
+		sample.cycles = group.values[0];
+		sample.instructions = group.values[1];
+		sample.cacheReferences = group.values[2];
+		sample.cacheMisses = group.values[3];
+	}
+	close();
+	return sample;
+}
+
+#else
+
+PerfCounters::PerfCounters() :
+	available(false)
+{
+	for (int& fd : fds) {
+		fd = -1;
+	}
+}
+
+PerfCounters::~PerfCounters() {}
+
+bool PerfCounters::open() {
+	return false;
+}
+
+void PerfCounters::close() {}
+
+bool PerfCounters::isAvailable() const {
+	return false;
+}
+
+void PerfCounters::start() {}
+
+PerfSample PerfCounters::stop() {
+	return PerfSample();
+}
+
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+
+struct PerfSample {
+	bool valid = false;
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t cacheReferences = 0;
+	uint64_t cacheMisses = 0;
+
+	double ipc() const {
+		return (cycles == 0) ? 0.0 : instructions / (double)cycles;
+	}
+};
+
+
+// Hardware counters for the calling thread and any threads it starts while counting.
+// Uses perf_event_open on Linux; elsewhere, or when the kernel refuses access, samples are invalid.
+// The counters are opened as one group by start and closed by stop, so they share one scheduling window
+// and counts from threads of earlier samples can't leak into later ones.
+class PerfCounters {
+
+public:
+	PerfCounters();
+	~PerfCounters();
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool isAvailable() const;
+
+	void start();
+	PerfSample stop();
+
+private:
+	static constexpr int NUM_COUNTERS = 4;
+	bool available;
+	int fds[NUM_COUNTERS];
+
+	bool open();
+	void close();
+};
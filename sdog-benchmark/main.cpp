@@ -0,0 +1,144 @@
+#include "Benchmark.h"
+
+#include "Instrumentation.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+
+static void printUsage() {
+
+	std::cout << "usage: sdog-benchmark [options]" << std::endl;
+	std::cout << "  --variants a,b,...   variants to run (default all)" << std::endl;
+	std::cout << "  --k min[-max]        refinement levels (default 1-21)" << std::endl;
+	std::cout << "  --n count            inputs per measurement (default 1000000)" << std::endl;
+	std::cout << "  --threads a,b,...    thread counts (default 1)" << std::endl;
+	std::cout << "  --reps count         timed passes per measurement (default 5)" << std::endl;
+	std::cout << "  --batch count        operations per latency sample (default 64)" << std::endl;
+	std::cout << "  --cache-mb size      cache budget for cached variants (default 64)" << std::endl;
+	std::cout << "  --workload name      parameter, volume, surface, polar, clustered or trajectory (default volume)" << std::endl;
+	std::cout << "  --seed value         input seed (default 1)" << std::endl;
+	std::cout << "  --no-counters        don't read hardware counters" << std::endl;
+	std::cout << "  --json file          write results as JSON" << std::endl;
+	std::cout << "  --csv file           write results as CSV" << std::endl;
+	std::cout << "  --instrument file    write instrumentation counters as JSON (needs SDOG_INSTRUMENT)" << std::endl;
+	std::cout << "  --list               list variants" << std::endl;
+}
+
+
+static std::vector<std::string> split(const std::string& s, char delim) {
+
+	std::vector<std::string> parts;
+	std::stringstream ss(s);
+	std::string part;
+	while (std::getline(ss, part, delim)) {
+		if (!part.empty()) {
+			parts.push_back(part);
+		}
+	}
+	return parts;
+}
+
+
+int main(int argc, char* argv[]) {
+
+	BenchmarkConfig config;
+	std::string jsonFile;
+	std::string csvFile;
+	std::string instrumentFile;
+
+	for (int i = 1; i < argc; i++) {
+
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--variants" && hasValue) {
+			config.variants = split(argv[++i], ',');
+		}
+		else if (arg == "--k" && hasValue) {
+			std::vector<std::string> ks = split(argv[++i], '-');
+			config.minK = atoi(ks.front().c_str());
+			config.maxK = atoi(ks.back().c_str());
+		}
+		else if (arg == "--n" && hasValue) {
+			config.n = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--threads" && hasValue) {
+			config.threads.clear();
+			for (const std::string& t : split(argv[++i], ',')) {
+				config.threads.push_back((unsigned int)atoi(t.c_str()));
+			}
+		}
+		else if (arg == "--reps" && hasValue) {
+			config.repetitions = atoi(argv[++i]);
+		}
+		else if (arg == "--batch" && hasValue) {
+			config.batchSize = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--cache-mb" && hasValue) {
+			config.cacheBudget = strtoull(argv[++i], nullptr, 10) << 20;
+		}
+		else if (arg == "--workload" && hasValue) {
+			if (!WorkloadGenerator::parseDistribution(argv[++i], config.distribution)) {
+				std::cerr << "unknown workload " << argv[i] << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--seed" && hasValue) {
+			config.seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+		}
+		else if (arg == "--no-counters") {
+			config.counters = false;
+		}
+		else if (arg == "--json" && hasValue) {
+			jsonFile = argv[++i];
+		}
+		else if (arg == "--csv" && hasValue) {
+			csvFile = argv[++i];
+		}
+		else if (arg == "--instrument" && hasValue) {
+			instrumentFile = argv[++i];
+			if (!Instrumentation::enabled()) {
+				std::cerr << "instrumentation is not compiled in, define SDOG_INSTRUMENT" << std::endl;
+				return 1;
+			}
+		}
+		else if (arg == "--list") {
+			for (const std::string& name : Benchmark::variantNames()) {
+				std::cout << name << std::endl;
+			}
+			return 0;
+		}
+		else {
+			printUsage();
+			return (arg == "--help" || arg == "-h") ? 0 : 1;
+		}
+	}
+
+	Benchmark benchmark(config);
+	Instrumentation::reset();
+	std::vector<BenchmarkResult> results = benchmark.run();
+	InstrumentationSnapshot snapshot = Instrumentation::snapshot();
+
+	Benchmark::printTable(results);
+
+	if (!jsonFile.empty() && !Benchmark::writeJson(results, jsonFile)) {
+		std::cerr << "could not write " << jsonFile << std::endl;
+		return 1;
+	}
+	if (!csvFile.empty() && !Benchmark::writeCsv(results, csvFile)) {
+		std::cerr << "could not write " << csvFile << std::endl;
+		return 1;
+	}
+	if (!instrumentFile.empty()) {
+		std::ofstream file(instrumentFile);
+		snapshot.writeJson(file);
+		if (!file) {
+			std::cerr << "could not write " << instrumentFile << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
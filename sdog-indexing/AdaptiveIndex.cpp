@@ -0,0 +1,176 @@
+#include "AdaptiveIndex.h"
+
+#include <algorithm>
+
+
+AdaptiveIndex::AdaptiveIndex(int maxPoints) :
+	maxPoints(maxPoints),
+	k(0)
+{}
+
+
+void AdaptiveIndex::build(std::vector<Index> keys, int k) {
+
+	this->keys = std::move(keys);
+	this->k = k;
+
+	starts.clear();
+	levels.clear();
+	offsets.clear();
+
+	if (!this->keys.empty()) {
+		buildCell(1, 0, 0, this->keys.size());
+	}
+	offsets.push_back(this->keys.size());
+}
+
+
+// Children are visited in key order so leaves come out sorted
+void AdaptiveIndex::buildCell(Index cell, int level, size_t begin, size_t end) {
+
+	int shift = 3 * (k - level);
+	if (level == k || end - begin <= (size_t)maxPoints) {
+		starts.push_back(cell << shift);
+		levels.push_back((uint8_t)level);
+		offsets.push_back(begin);
+		return;
+	}
+
+	Index children[8];
+	int numChildren = indexChildren(cell, children);
+
+	for (int i = 0; i < numChildren; i++) {
+
+		Index first = children[i] << (shift - 3);
+		Index last = ((children[i] + 1) << (shift - 3)) - 1;
+
+		size_t childBegin = std::lower_bound(keys.begin() + begin, keys.begin() + end, first) - keys.begin();
+		size_t childEnd = std::upper_bound(keys.begin() + childBegin, keys.begin() + end, last) - keys.begin();
+
+		if (childBegin != childEnd) {
+			buildCell(children[i], level + 1, childBegin, childEnd);
+		}
+	}
+}
+
+
+size_t AdaptiveIndex::numLeaves() const {
+	return starts.size();
+}
+
+
+Index AdaptiveIndex::leafCell(size_t leaf) const {
+	return starts[leaf] >> (3 * (k - levels[leaf]));
+}
+
+
+int AdaptiveIndex::leafLevel(size_t leaf) const {
+	return levels[leaf];
+}
+
+
+size_t AdaptiveIndex::leafSize(size_t leaf) const {
+	return offsets[leaf + 1] - offsets[leaf];
+}
+
+
+Range AdaptiveIndex::leafRange(size_t leaf, const IndexOperations* io) const {
+	return io->indexToRange(leafCell(leaf));
+}
+
+
+size_t AdaptiveIndex::findLeaf(Index key) const {
+
+	size_t leaf = std::upper_bound(starts.begin(), starts.end(), key) - starts.begin();
+	if (leaf == 0 || (key >> (3 * (k - levels[leaf - 1]))) != leafCell(leaf - 1)) {
+		return numLeaves();
+	}
+	return leaf - 1;
+}
+
+
+std::vector<size_t> AdaptiveIndex::leavesIn(const std::vector<IndexInterval>& intervals) const {
+
+	std::vector<size_t> leaves;
+	for (const IndexInterval& interval : intervals) {
+
+		// Start from the leaf containing the first key if there is one, otherwise the next leaf
+		size_t leaf = findLeaf(interval.first);
+		if (leaf == numLeaves()) {
+			leaf = std::upper_bound(starts.begin(), starts.end(), interval.first) - starts.begin();
+		}
+
+		for (; leaf < numLeaves() && starts[leaf] <= interval.second; leaf++) {
+
+			// Intervals are sorted so a leaf can only repeat from the previous interval
+			if (leaves.empty() || leaves.back() != leaf) {
+				leaves.push_back(leaf);
+			}
+		}
+	}
+	return leaves;
+}
+
+
+std::vector<std::pair<size_t, size_t>> AdaptiveIndex::keyRanges(const std::vector<IndexInterval>& intervals) const {
+
+	std::vector<std::pair<size_t, size_t>> ranges;
+	for (const IndexInterval& interval : intervals) {
+
+		size_t begin = lowerKey(interval.first);
+		size_t end = lowerKey(interval.second + 1);
+		if (begin != end) {
+			ranges.push_back(std::pair<size_t, size_t>(begin, end));
+		}
+	}
+	return ranges;
+}
+
+
+size_t AdaptiveIndex::count(const std::vector<IndexInterval>& intervals) const {
+
+	size_t total = 0;
+	for (const IndexInterval& interval : intervals) {
+		total += lowerKey(interval.second + 1) - lowerKey(interval.first);
+	}
+	return total;
+}
+
+
+// Searches the leaf starts and then at most one leaf's keys, instead of the whole key array
+size_t AdaptiveIndex::lowerKey(Index key) const {
+
+	size_t leaf = findLeaf(key);
+	if (leaf == numLeaves()) {
+
+		// In an empty region, the answer is the first key of the next leaf
+		size_t next = std::upper_bound(starts.begin(), starts.end(), key) - starts.begin();
+		return offsets[next];
+	}
+	return std::lower_bound(keys.begin() + offsets[leaf], keys.begin() + offsets[leaf + 1], key) - keys.begin();
+}
+
+
+const std::vector<Index>& AdaptiveIndex::getKeys() const {
+	return keys;
+}
+
+
+int AdaptiveIndex::getLevel() const {
+	return k;
+}
+
+
+std::vector<size_t> AdaptiveIndex::levelCounts() const {
+
+	std::vector<size_t> counts(k + 1, 0);
+	for (uint8_t level : levels) {
+		counts[level]++;
+	}
+	return counts;
+}
+
+
+size_t AdaptiveIndex::memoryBytes() const {
+	return starts.size() * sizeof(Index) + levels.size() * sizeof(uint8_t) + offsets.size() * sizeof(size_t);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "IndexOperations.h"
+#include "RegionCoverer.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+// Tree of SDOG cells over a set of level k keys, refined from the root only where a cell holds more than
+// maxPoints keys, so dense regions end up in deep leaves and sparse regions in shallow ones. Empty cells
+// are left out. The tree has no pointers: leaves are stored in key order as the first level k key and level
+// of each leaf cell, and the keys of leaf i are keys[offsets[i], offsets[i + 1]).
+class AdaptiveIndex {
+
+public:
+	AdaptiveIndex(int maxPoints);
+
+	// keys must be sorted valid level k keys. Leaves at level k can hold more than maxPoints duplicates.
+	void build(std::vector<Index> keys, int k);
+
+	size_t numLeaves() const;
+	Index leafCell(size_t leaf) const;
+	int leafLevel(size_t leaf) const;
+	size_t leafSize(size_t leaf) const;
+	Range leafRange(size_t leaf, const IndexOperations* io) const;
+
+	// Leaf containing a level k key, numLeaves() if the key is in an empty region
+	size_t findLeaf(Index key) const;
+
+	// Queries take sorted level k intervals, such as from RegionCoverer::coverIntervals with maxLevel k
+	std::vector<size_t> leavesIn(const std::vector<IndexInterval>& intervals) const;
+	std::vector<std::pair<size_t, size_t>> keyRanges(const std::vector<IndexInterval>& intervals) const;
+	size_t count(const std::vector<IndexInterval>& intervals) const;
+
+	const std::vector<Index>& getKeys() const;
+	int getLevel() const;
+
+	// Number of leaves at each level from 0 to k
+	std::vector<size_t> levelCounts() const;
+
+	// Bytes used by the tree, not counting the keys
+	size_t memoryBytes() const;
+
+private:
+	int maxPoints;
+	int k;
+
+	std::vector<Index> keys;
+	std::vector<Index> starts;
+	std::vector<uint8_t> levels;
+	std::vector<size_t> offsets;
+
+	void buildCell(Index cell, int level, size_t begin, size_t end);
+
+	// Position in keys of the first key >= key
+	size_t lowerKey(Index key) const;
+};
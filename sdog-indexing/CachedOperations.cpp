@@ -0,0 +1,113 @@
+#include "CachedOperations.h"
+
+#include "Instrumentation.h"
+
+#include <algorithm>
+
+
+// Approximate bytes used by one cached range: the list node, the hash map node and its bucket
+constexpr size_t ENTRY_BYTES = sizeof(std::pair<Index, Range>) + 2 * sizeof(void*) +
+                               sizeof(Index) + 3 * sizeof(void*) + sizeof(void*);
+
+
+CachedOperations::CachedOperations(const IndexOperations* io, size_t memoryBudget, unsigned int numShards) :
+	io(io)
+{
+	numShards = std::max(numShards, 1u);
+	size_t capacity = std::max(memoryBudget / ENTRY_BYTES / numShards, (size_t)1);
+
+	for (unsigned int i = 0; i < numShards; i++) {
+		shards.push_back(std::make_unique<Shard>());
+		shards.back()->capacity = capacity;
+		shards.back()->entries.reserve(capacity);
+	}
+}
+
+
+Index CachedOperations::pointToIndex(const Point& p, int k) const {
+	return io->pointToIndex(p, k);
+}
+
+
+Range CachedOperations::indexToRange(Index index) const {
+
+	SDOG_TIME(Operation::CACHED_INDEX_TO_RANGE);
+
+	Shard& shard = shardFor(index);
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		auto it = shard.entries.find(index);
+		if (it != shard.entries.end()) {
+			shard.stats.hits++;
+			shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+			return it->second->second;
+		}
+		shard.stats.misses++;
+	}
+
+	// Decode without holding the lock, it is the expensive part
+	Range r = io->indexToRange(index);
+
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	// Another thread may have inserted the same index while this one was decoding
+	if (shard.entries.find(index) != shard.entries.end()) {
+		return r;
+	}
+	if (shard.lru.size() >= shard.capacity) {
+		shard.entries.erase(shard.lru.back().first);
+		shard.lru.pop_back();
+		shard.stats.evictions++;
+	}
+	shard.lru.emplace_front(index, r);
+	shard.entries[index] = shard.lru.begin();
+
+	return r;
+}
+
+
+CacheStats CachedOperations::getStats() const {
+
+	CacheStats total;
+	for (const std::unique_ptr<Shard>& shard : shards) {
+
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		total.hits += shard->stats.hits;
+		total.misses += shard->stats.misses;
+		total.evictions += shard->stats.evictions;
+	}
+	return total;
+}
+
+
+void CachedOperations::resetStats() {
+
+	for (std::unique_ptr<Shard>& shard : shards) {
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		shard->stats = CacheStats();
+	}
+}
+
+
+void CachedOperations::clear() {
+
+	for (std::unique_ptr<Shard>& shard : shards) {
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		shard->lru.clear();
+		shard->entries.clear();
+	}
+}
+
+
+size_t CachedOperations::getCapacity() const {
+	return shards.size() * shards.front()->capacity;
+}
+
+
+// Mixes index bits so neighbouring cells spread across shards
+CachedOperations::Shard& CachedOperations::shardFor(Index index) const {
+
+	uint64_t h = (uint64_t)index * 0x9E3779B97F4A7C15ull;
+	return *shards[(h >> 32) % shards.size()];
+}
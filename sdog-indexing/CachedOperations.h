@@ -0,0 +1,57 @@
+#pragma once
+
+#include "IndexOperations.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
+struct CacheStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+	uint64_t evictions = 0;
+
+	double hitRate() const {
+		return (hits + misses == 0) ? 0.0 : hits / (double)(hits + misses);
+	}
+};
+
+
+// Wraps another IndexOperations and keeps recently decoded ranges in a bounded LRU cache.
+// The cache is split into independently locked shards so it can be shared between threads.
+class CachedOperations : public IndexOperations {
+
+public:
+	// memoryBudget is in bytes and includes an estimate of the container overhead per entry
+	CachedOperations(const IndexOperations* io, size_t memoryBudget, unsigned int numShards = 16);
+
+	Index pointToIndex(const Point& p, int k) const;
+	Range indexToRange(Index index) const;
+
+	CacheStats getStats() const;
+	void resetStats();
+	void clear();
+
+	// Maximum number of ranges held across all shards
+	size_t getCapacity() const;
+
+private:
+	typedef std::list<std::pair<Index, Range>> LruList;
+
+	struct Shard {
+		std::mutex mutex;
+		LruList lru; // most recently used at front
+		std::unordered_map<Index, LruList::iterator> entries;
+		size_t capacity;
+		CacheStats stats;
+	};
+
+	const IndexOperations* io;
+	std::vector<std::unique_ptr<Shard>> shards;
+
+	Shard& shardFor(Index index) const;
+};
@@ -0,0 +1,460 @@
+#include "DifferentialTester.h"
+
+#include "Parallel.h"
+
+#include <libmorton/morton.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+
+// Points generated per chunk of a random test
+constexpr uint64_t CHUNK_SIZE = 1 << 16;
+
+// Unminimized failures kept per reported one, many of them shrink to the same case
+constexpr size_t CANDIDATES_PER_FAILURE = 4;
+
+
+// Many failing inputs shrink to the same minimal case
+static bool samePoint(const PointMismatch& a, const PointMismatch& b) {
+	return a.k == b.k && a.p.rad == b.p.rad && a.p.lat == b.p.lat && a.p.lng == b.p.lng;
+}
+
+
+static void addFailure(std::vector<PointMismatch>& failures, const PointMismatch& m, size_t maxFailures) {
+
+	if (failures.size() >= maxFailures) {
+		return;
+	}
+	for (const PointMismatch& f : failures) {
+		if (samePoint(f, m)) {
+			return;
+		}
+	}
+	failures.push_back(m);
+}
+
+
+// Cells of the same type whose angular bounds and their errors match, such as the cells above each other in
+// every shell, show the same defect. Their radial bounds differ, so minimize can't find them as ancestors.
+static bool sameDefect(const RangeMismatch& a, const RangeMismatch& b) {
+
+	auto sameAngles = [](const Range& x, const Range& y) {
+		return x.latMin == y.latMin && x.latMax == y.latMax && x.lngMin == y.lngMin && x.lngMax == y.lngMax;
+	};
+	return a.index == b.index || (indexCellType(a.index) == indexCellType(b.index) &&
+	                              sameAngles(a.expected, b.expected) && sameAngles(a.actual, b.actual));
+}
+
+
+// A defect is reported once, by its shallowest cell
+static void addFailure(std::vector<RangeMismatch>& failures, const RangeMismatch& m, size_t maxFailures) {
+
+	for (RangeMismatch& f : failures) {
+		if (sameDefect(f, m)) {
+			if (indexLevel(m.index) < indexLevel(f.index)) {
+				f = m;
+			}
+			return;
+		}
+	}
+	if (failures.size() < maxFailures) {
+		failures.push_back(m);
+	}
+}
+
+
+void DifferentialReport::merge(const DifferentialReport& other, size_t maxFailures) {
+
+	pointTests += other.pointTests;
+	pointErrors += other.pointErrors;
+	rangeTests += other.rangeTests;
+	rangeErrors += other.rangeErrors;
+
+	for (int i = 0; i < 6; i++) {
+		maxUlps[i] = std::max(maxUlps[i], other.maxUlps[i]);
+	}
+	for (const PointMismatch& m : other.pointFailures) {
+		addFailure(pointFailures, m, maxFailures);
+	}
+	for (const RangeMismatch& m : other.rangeFailures) {
+		addFailure(rangeFailures, m, maxFailures);
+	}
+}
+
+
+void DifferentialReport::print(std::ostream& os) const {
+
+	os << "PtoI errors: " << pointErrors << " of " << pointTests << std::endl;
+	os << "ItoR errors: " << rangeErrors << " of " << rangeTests << std::endl;
+	os << "max ULPs: rad [" << maxUlps[0] << ", " << maxUlps[1] << "] ";
+	os << "lat [" << maxUlps[2] << ", " << maxUlps[3] << "] ";
+	os << "lng [" << maxUlps[4] << ", " << maxUlps[5] << "]" << std::endl;
+
+	for (const PointMismatch& m : pointFailures) {
+		os.precision(17);
+		os << "  PtoI k = " << m.k << " at " << m.p << std::endl;
+		os << "    expected " << std::bitset<64>(m.expected) << std::endl;
+		os << "    actual   " << std::bitset<64>(m.actual) << std::endl;
+	}
+	for (const RangeMismatch& m : rangeFailures) {
+		os.precision(17);
+		os << "  ItoR " << std::bitset<64>(m.index) << " (" << m.ulps << " ULPs)" << std::endl;
+		os << "    expected " << m.expected << std::endl;
+		os << "    actual   " << m.actual << std::endl;
+	}
+	os.precision(6);
+}
+
+
+DifferentialTester::DifferentialTester(const IndexOperations* reference, const IndexOperations* candidate, unsigned int numThreads) :
+	reference(reference),
+	candidate(candidate),
+	numThreads((numThreads == 0) ? defaultThreadCount() : numThreads),
+	ulpTolerance(16),
+	maxFailures(10)
+{}
+
+
+void DifferentialTester::setUlpTolerance(uint64_t ulps) {
+	ulpTolerance = ulps;
+}
+
+
+void DifferentialTester::setMaxFailures(size_t maxFailures) {
+	this->maxFailures = maxFailures;
+}
+
+
+// Distance between doubles in representable steps, maximal if either is NaN
+uint64_t DifferentialTester::ulpDistance(double a, double b) {
+
+	if (std::isnan(a) || std::isnan(b)) {
+		return UINT64_MAX;
+	}
+
+	// Map the sign-magnitude encoding onto a monotonic integer line
+	auto ordered = [](double d) {
+		int64_t bits;
+		memcpy(&bits, &d, sizeof(d));
+		return (bits < 0) ? INT64_MIN - bits : bits;
+	};
+	int64_t ia = ordered(a);
+	int64_t ib = ordered(b);
+	return (ia > ib) ? (uint64_t)ia - (uint64_t)ib : (uint64_t)ib - (uint64_t)ia;
+}
+
+
+// Coordinates every variant accepts, the encoders take logs of the radius and the distance to the pole
+static bool inDomain(const Point& p) {
+	return p.rad > 0.0 && p.rad <= GRID_RAD && p.lat >= 0.0 && p.lat < M_PI_2 && p.lng >= 0.0 && p.lng < M_PI_2;
+}
+
+
+bool DifferentialTester::pointFails(const Point& p, int k) const {
+	return reference->pointToIndex(p, k) != candidate->pointToIndex(p, k);
+}
+
+
+// Fills per bound distances and returns the largest
+uint64_t DifferentialTester::rangeUlps(const Range& a, const Range& b, uint64_t ulps[6]) const {
+
+	ulps[0] = ulpDistance(a.radMin, b.radMin);
+	ulps[1] = ulpDistance(a.radMax, b.radMax);
+	ulps[2] = ulpDistance(a.latMin, b.latMin);
+	ulps[3] = ulpDistance(a.latMax, b.latMax);
+	ulps[4] = ulpDistance(a.lngMin, b.lngMin);
+	ulps[5] = ulpDistance(a.lngMax, b.lngMax);
+
+	return *std::max_element(ulps, ulps + 6);
+}
+
+
+void DifferentialTester::testPoint(const Point& p, int k, DifferentialReport& report) const {
+
+	report.pointTests++;
+
+	Index expected = reference->pointToIndex(p, k);
+	Index actual = candidate->pointToIndex(p, k);
+
+	if (expected != actual) {
+		report.pointErrors++;
+		PointMismatch m = { p, k, expected, actual };
+		addFailure(report.pointFailures, m, maxFailures * CANDIDATES_PER_FAILURE);
+		return;
+	}
+	testIndex(expected, report);
+}
+
+
+void DifferentialTester::testIndex(Index index, DifferentialReport& report) const {
+
+	report.rangeTests++;
+
+	uint64_t ulps[6];
+	Range expected = reference->indexToRange(index);
+	Range actual = candidate->indexToRange(index);
+	uint64_t maxUlps = rangeUlps(expected, actual, ulps);
+
+	for (int i = 0; i < 6; i++) {
+		report.maxUlps[i] = std::max(report.maxUlps[i], ulps[i]);
+	}
+
+	if (maxUlps > ulpTolerance) {
+		report.rangeErrors++;
+		RangeMismatch m = { index, expected, actual, maxUlps };
+		addFailure(report.rangeFailures, m, maxFailures * CANDIDATES_PER_FAILURE);
+	}
+}
+
+
+DifferentialReport DifferentialTester::testRandom(uint64_t n, int k, Distribution distribution, uint64_t seed) const {
+
+	uint64_t numChunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	std::atomic<uint64_t> nextChunk(0);
+
+	std::vector<DifferentialReport> reports(numThreads);
+	parallelFor(numThreads, numThreads, [&](size_t, size_t, unsigned int t) {
+
+		PointBuffer buffer;
+		for (uint64_t chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++) {
+
+			// Each chunk has its own stream so results don't depend on which thread takes it
+			WorkloadGenerator generator(distribution, seed * 0x9E3779B97F4A7C15ull + chunk, 1);
+			generator.generate(std::min(CHUNK_SIZE, n - chunk * CHUNK_SIZE), buffer);
+
+			for (size_t i = 0; i < buffer.size(); i++) {
+				testPoint(buffer[i], k, reports[t]);
+			}
+		}
+	});
+
+	return finish(reports);
+}
+
+
+DifferentialReport DifferentialTester::testBoundaries(int k, int ulpRadius) const {
+
+	// Cells whose outer radial bound is a shell boundary and whose lower latitude bound is a zone
+	// boundary in that shell, plus the innermost and polar cells. The cells come from the parametric
+	// structure shared by all variants, their bounds come from the reference.
+	std::vector<Index> cells;
+
+	DimIndex numRad = 1u << k;
+	for (int s = 0; s <= k; s++) {
+
+		DimIndex radI = (s < k) ? numRad - (numRad >> s) : numRad - 1;
+		int latBits = k - s;
+
+		for (int z = 0; z <= latBits; z++) {
+
+			DimIndex numLat = 1u << latBits;
+			DimIndex latI = (z < latBits) ? numLat - (numLat >> z) : numLat - 1;
+			int lngBits = std::max(latBits - z, 0);
+
+			DimIndex numLng = 1u << lngBits;
+			DimIndex lngs[] = { 0, 1, numLng / 2, numLng - 1 };
+			for (DimIndex lngI : lngs) {
+				if (lngI < numLng) {
+					cells.push_back(libmorton::morton3D_64_encode(lngI, latI, radI) + (1ll << (k * 3)));
+				}
+			}
+		}
+	}
+	std::sort(cells.begin(), cells.end());
+	cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+	// Values within ulpRadius steps of a bound
+	auto around = [&](double bound, std::vector<double>& values) {
+		double below = bound;
+		double above = bound;
+		values.push_back(bound);
+		for (int i = 0; i < ulpRadius; i++) {
+			below = nextafter(below, -INFINITY);
+			above = nextafter(above, INFINITY);
+			values.push_back(below);
+			values.push_back(above);
+		}
+	};
+
+	std::vector<DifferentialReport> reports(numThreads);
+	parallelFor(cells.size(), numThreads, [&](size_t begin, size_t end, unsigned int t) {
+
+		std::vector<double> rads, lats, lngs;
+		for (size_t c = begin; c < end; c++) {
+
+			Range r = reference->indexToRange(cells[c]);
+
+			rads.clear();
+			lats.clear();
+			lngs.clear();
+			around(r.radMin, rads);
+			around(r.radMax, rads);
+			around(r.latMin, lats);
+			around(r.latMax, lats);
+			around(r.lngMin, lngs);
+			around(r.lngMax, lngs);
+
+			for (double rad : rads) {
+				for (double lat : lats) {
+					for (double lng : lngs) {
+						Point p(rad, lat, lng);
+						if (inDomain(p)) {
+							testPoint(p, k, reports[t]);
+						}
+					}
+				}
+			}
+		}
+	});
+
+	return finish(reports);
+}
+
+
+DifferentialReport DifferentialTester::testAllIndices(int k) const {
+
+	// Expand a few levels on this thread then give each thread whole subtrees
+	std::vector<Index> roots = { 1 };
+	int rootLevel = 0;
+	while (rootLevel < k && roots.size() < numThreads * 16) {
+
+		std::vector<Index> next;
+		for (Index index : roots) {
+			Index children[8];
+			int numChildren = indexChildren(index, children);
+			next.insert(next.end(), children, children + numChildren);
+		}
+		roots.swap(next);
+		rootLevel++;
+	}
+
+	std::vector<DifferentialReport> reports(numThreads);
+	parallelFor(roots.size(), numThreads, [&](size_t begin, size_t end, unsigned int t) {
+
+		std::vector<Index> stack;
+		for (size_t i = begin; i < end; i++) {
+
+			stack.push_back(roots[i]);
+			while (!stack.empty()) {
+
+				Index index = stack.back();
+				stack.pop_back();
+
+				if (indexLevel(index) == k) {
+					testIndex(index, reports[t]);
+					continue;
+				}
+				Index children[8];
+				int numChildren = indexChildren(index, children);
+				stack.insert(stack.end(), children, children + numChildren);
+			}
+		}
+	});
+
+	return finish(reports);
+}
+
+
+DifferentialReport DifferentialTester::finish(const std::vector<DifferentialReport>& reports) const {
+
+	DifferentialReport report;
+	for (const DifferentialReport& r : reports) {
+		report.merge(r, maxFailures * CANDIDATES_PER_FAILURE);
+	}
+
+	// Shrinking is the slow part, so it stops as soon as enough distinct cases are found
+	std::vector<PointMismatch> points;
+	std::vector<RangeMismatch> ranges;
+	points.swap(report.pointFailures);
+	ranges.swap(report.rangeFailures);
+
+	for (size_t i = 0; i < points.size() && report.pointFailures.size() < maxFailures; i++) {
+		addFailure(report.pointFailures, minimize(points[i].p, points[i].k), maxFailures);
+	}
+	for (size_t i = 0; i < ranges.size() && report.rangeFailures.size() < maxFailures; i++) {
+		addFailure(report.rangeFailures, minimize(ranges[i].index), maxFailures);
+	}
+	return report;
+}
+
+
+PointMismatch DifferentialTester::minimize(const Point& p, int k) const {
+
+	// Replace each coordinate with the value with the fewest significant bits that still fails
+	auto roundToBits = [](double v, int bits) {
+		if (v == 0.0) {
+			return v;
+		}
+		int exp;
+		double mantissa = frexp(v, &exp);
+		return ldexp(round(ldexp(mantissa, bits)), exp - bits);
+	};
+
+	// Simpler coordinates can fail at a lower level and a lower level can allow simpler coordinates,
+	// so both are repeated until neither changes. Each change lowers the level or drops bits, so this ends.
+	Point q = p;
+	int minK = k;
+	bool changed = true;
+	while (changed) {
+
+		changed = false;
+
+		// Indices share prefixes so the first differing level is the lowest failing one
+		for (int i = 1; i < minK; i++) {
+			if (pointFails(q, i)) {
+				minK = i;
+				changed = true;
+				break;
+			}
+		}
+
+		double* coords[] = { &q.rad, &q.lat, &q.lng };
+		for (double* c : coords) {
+
+			double original = *c;
+
+			*c = 0.0;
+			if (!(inDomain(q) && pointFails(q, minK))) {
+				for (int bits = 0; bits < 53; bits++) {
+					*c = roundToBits(original, bits);
+					if (inDomain(q) && pointFails(q, minK)) {
+						break;
+					}
+					*c = original;
+				}
+			}
+			changed = changed || *c != original;
+		}
+	}
+
+	PointMismatch m;
+	m.p = q;
+	m.k = minK;
+	m.expected = reference->pointToIndex(q, minK);
+	m.actual = candidate->pointToIndex(q, minK);
+	return m;
+}
+
+
+RangeMismatch DifferentialTester::minimize(Index index) const {
+
+	uint64_t ulps[6];
+	while (index >= 8) {
+
+		Index parent = index >> 3;
+		if (rangeUlps(reference->indexToRange(parent), candidate->indexToRange(parent), ulps) <= ulpTolerance) {
+			break;
+		}
+		index = parent;
+	}
+
+	RangeMismatch m;
+	m.index = index;
+	m.expected = reference->indexToRange(index);
+	m.actual = candidate->indexToRange(index);
+	m.ulps = rangeUlps(m.expected, m.actual, ulps);
+	return m;
+}
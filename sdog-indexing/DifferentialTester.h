@@ -0,0 +1,90 @@
+#pragma once
+
+#include "IndexOperations.h"
+#include "Workload.h"
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+
+struct PointMismatch {
+	Point p;
+	int k;
+	Index expected;
+	Index actual;
+};
+
+
+struct RangeMismatch {
+	Index index;
+	Range expected;
+	Range actual;
+	uint64_t ulps;
+};
+
+
+struct DifferentialReport {
+	uint64_t pointTests = 0;
+	uint64_t pointErrors = 0;
+	uint64_t rangeTests = 0;
+	uint64_t rangeErrors = 0;
+
+	// Largest distance seen for radMin, radMax, latMin, latMax, lngMin, lngMax
+	uint64_t maxUlps[6] = {};
+
+	// Minimized failures, at most maxFailures of each. Range failures repeating in other shells are reported once.
+	std::vector<PointMismatch> pointFailures;
+	std::vector<RangeMismatch> rangeFailures;
+
+	void merge(const DifferentialReport& other, size_t maxFailures);
+	void print(std::ostream& os) const;
+};
+
+
+// Compares a candidate IndexOperations against a reference on many inputs across threads.
+// Every point is encoded by both, and when the indices agree the index is decoded by both
+// and the range bounds are compared in ULPs. Failing inputs are shrunk before being reported.
+class DifferentialTester {
+
+public:
+	DifferentialTester(const IndexOperations* reference, const IndexOperations* candidate, unsigned int numThreads = 0);
+
+	// Largest ULP distance for a bound that still counts as agreeing, 16 by default
+	void setUlpTolerance(uint64_t ulps);
+	void setMaxFailures(size_t maxFailures);
+
+	// n points from a workload, generated in chunks so n can be far larger than memory
+	DifferentialReport testRandom(uint64_t n, int k, Distribution distribution, uint64_t seed) const;
+
+	// Points within ulpRadius ULPs of the bounds of cells at every shell and zone boundary
+	DifferentialReport testBoundaries(int k, int ulpRadius) const;
+
+	// Decodes every valid index at level k
+	DifferentialReport testAllIndices(int k) const;
+
+	// Lowest level and simplest coordinates that still give different indices
+	PointMismatch minimize(const Point& p, int k) const;
+
+	// Shallowest ancestor whose ranges still differ by more than the tolerance
+	RangeMismatch minimize(Index index) const;
+
+	static uint64_t ulpDistance(double a, double b);
+
+private:
+	const IndexOperations* reference;
+	const IndexOperations* candidate;
+	unsigned int numThreads;
+
+	uint64_t ulpTolerance;
+	size_t maxFailures;
+
+	bool pointFails(const Point& p, int k) const;
+
+	// Merges per thread reports and minimizes their failures
+	DifferentialReport finish(const std::vector<DifferentialReport>& reports) const;
+	uint64_t rangeUlps(const Range& a, const Range& b, uint64_t ulps[6]) const;
+
+	void testPoint(const Point& p, int k, DifferentialReport& report) const;
+	void testIndex(Index index, DifferentialReport& report) const;
+};
@@ -0,0 +1,256 @@
+#include "FieldStore.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#endif
+
+
+// Samples are processed in groups: all keys and bricks of a group are found and prefetched before any value is read
+constexpr size_t SAMPLE_GROUP = 16;
+
+
+static void prefetch(const void* p) {
+#ifdef _MSC_VER
+	_mm_prefetch((const char*)p, _MM_HINT_T0);
+#else
+	__builtin_prefetch(p);
+#endif
+}
+
+
+// Coordinate from a grid with 2^fromBits cells to one with 2^toBits cells, picking the finer
+// cell by the fractional position frac within the coarser one
+static int64_t rescale(int64_t i, int fromBits, int toBits, double frac) {
+
+	if (toBits <= fromBits) {
+		return i >> (fromBits - toBits);
+	}
+	int64_t split = 1ll << (toBits - fromBits);
+	return (i << (toBits - fromBits)) + std::min((int64_t)(frac * split), split - 1);
+}
+
+
+FieldStore::FieldStore(const IndexOperations* io, int k, int brickLevels) :
+	io(io),
+	k(k),
+	brickLevels(std::min(brickLevels, k)),
+	count(0)
+{
+	brickCells = (size_t)1 << (3 * this->brickLevels);
+	brickWords = (brickCells + 63) / 64;
+}
+
+
+void FieldStore::set(Index key, double value) {
+
+	Index ancestor = key >> (3 * brickLevels);
+	size_t slot = key & (brickCells - 1);
+
+	auto it = bricks.find(ancestor);
+	uint32_t brick;
+	if (it == bricks.end()) {
+		brick = (uint32_t)bricks.size();
+		bricks[ancestor] = brick;
+		values.resize(values.size() + brickCells, 0.0);
+		present.resize(present.size() + brickWords, 0);
+	}
+	else {
+		brick = it->second;
+	}
+
+	uint64_t& word = present[brick * brickWords + slot / 64];
+	uint64_t bit = 1ull << (slot % 64);
+	if (!(word & bit)) {
+		word |= bit;
+		count++;
+	}
+	values[brick * brickCells + slot] = value;
+}
+
+
+bool FieldStore::get(Index key, double& value) const {
+	return get(findBrick(key), key, value);
+}
+
+
+bool FieldStore::contains(Index key) const {
+	double value;
+	return get(key, value);
+}
+
+
+size_t FieldStore::size() const {
+	return count;
+}
+
+
+size_t FieldStore::numBricks() const {
+	return bricks.size();
+}
+
+
+// Approximate, the hash map is counted as one node and bucket per brick
+size_t FieldStore::memoryBytes() const {
+	size_t mapBytes = bricks.size() * (sizeof(std::pair<Index, uint32_t>) + 2 * sizeof(void*));
+	return values.size() * sizeof(double) + present.size() * sizeof(uint64_t) + mapBytes;
+}
+
+
+int64_t FieldStore::findBrick(Index key) const {
+
+	auto it = bricks.find(key >> (3 * brickLevels));
+	return (it == bricks.end()) ? -1 : it->second;
+}
+
+
+bool FieldStore::get(int64_t brick, Index key, double& value) const {
+
+	if (brick < 0) {
+		return false;
+	}
+	size_t slot = key & (brickCells - 1);
+	if (!(present[brick * brickWords + slot / 64] & (1ull << (slot % 64)))) {
+		return false;
+	}
+	value = values[brick * brickCells + slot];
+	return true;
+}
+
+
+void FieldStore::sampleNearest(const std::vector<Point>& points, std::vector<double>& samples, std::vector<uint8_t>& found, unsigned int numThreads) const {
+
+	samples.resize(points.size());
+	found.resize(points.size());
+
+	parallelFor(points.size(), numThreads, [&](size_t begin, size_t end, unsigned int) {
+
+		Index keys[SAMPLE_GROUP];
+		int64_t brickNums[SAMPLE_GROUP];
+
+		for (size_t g = begin; g < end; g += SAMPLE_GROUP) {
+
+			size_t n = std::min(SAMPLE_GROUP, end - g);
+			for (size_t i = 0; i < n; i++) {
+				keys[i] = io->pointToIndex(points[g + i], k);
+				brickNums[i] = findBrick(keys[i]);
+				if (brickNums[i] >= 0) {
+					prefetch(&values[brickNums[i] * brickCells + (keys[i] & (brickCells - 1))]);
+				}
+			}
+			for (size_t i = 0; i < n; i++) {
+				double value = 0.0;
+				found[g + i] = get(brickNums[i], keys[i], value);
+				samples[g + i] = value;
+			}
+		}
+	});
+}
+
+
+void FieldStore::sampleInterpolated(const std::vector<Point>& points, std::vector<double>& samples, std::vector<uint8_t>& found, unsigned int numThreads) const {
+
+	samples.resize(points.size());
+	found.resize(points.size());
+
+	parallelFor(points.size(), numThreads, [&](size_t begin, size_t end, unsigned int) {
+
+		Index cells[SAMPLE_GROUP][8];
+		double weights[SAMPLE_GROUP][8];
+		int64_t brickNums[SAMPLE_GROUP][8];
+		int numCells[SAMPLE_GROUP];
+
+		for (size_t g = begin; g < end; g += SAMPLE_GROUP) {
+
+			size_t n = std::min(SAMPLE_GROUP, end - g);
+			for (size_t i = 0; i < n; i++) {
+
+				const Point& p = points[g + i];
+				numCells[i] = stencil(p, io->pointToIndex(p, k), cells[i], weights[i]);
+
+				for (int c = 0; c < numCells[i]; c++) {
+					brickNums[i][c] = findBrick(cells[i][c]);
+					if (brickNums[i][c] >= 0) {
+						prefetch(&values[brickNums[i][c] * brickCells + (cells[i][c] & (brickCells - 1))]);
+					}
+				}
+			}
+
+			for (size_t i = 0; i < n; i++) {
+
+				double sum = 0.0;
+				double totalWeight = 0.0;
+				for (int c = 0; c < numCells[i]; c++) {
+
+					double value;
+					if (get(brickNums[i][c], cells[i][c], value)) {
+						sum += weights[i][c] * value;
+						totalWeight += weights[i][c];
+					}
+				}
+				found[g + i] = totalWeight > 0.0;
+				samples[g + i] = (totalWeight > 0.0) ? sum / totalWeight : 0.0;
+			}
+		}
+	});
+}
+
+
+// Writes the cells and weights used to interpolate at p, which is in cell key, and returns how many there are.
+// Neighbour coordinates are found in index space: a step in radius can change latitude resolution and a step in
+// latitude can change longitude resolution, so coordinates are rescaled after each step.
+int FieldStore::stencil(const Point& p, Index key, Index cells[8], double weights[8]) const {
+
+	int level;
+	DimIndex radI, latI, lngI;
+	indexCoordinates(key, level, radI, latI, lngI);
+	Range r = io->indexToRange(key);
+
+	// Position in the cell in each coordinate
+	double radFrac = std::min(std::max((p.rad - r.radMin) / (r.radMax - r.radMin), 0.0), 1.0);
+	double latFrac = std::min(std::max((p.lat - r.latMin) / (r.latMax - r.latMin), 0.0), 1.0);
+	double lngFrac = std::min(std::max((p.lng - r.lngMin) / (r.lngMax - r.lngMin), 0.0), 1.0);
+
+	// Neighbour direction and weight, radI counts inwards
+	int dRad = (radFrac >= 0.5) ? -1 : 1;
+	int dLat = (latFrac >= 0.5) ? 1 : -1;
+	int dLng = (lngFrac >= 0.5) ? 1 : -1;
+	double wRad = fabs(radFrac - 0.5);
+	double wLat = fabs(latFrac - 0.5);
+	double wLng = fabs(lngFrac - 0.5);
+
+	int latBits = latitudeBits(level, radI);
+	int lngBits = longitudeBits(level, radI, latI);
+
+	int n = 0;
+	for (int c = 0; c < 8; c++) {
+
+		int sRad = (c >> 2) & 1;
+		int sLat = (c >> 1) & 1;
+		int sLng = c & 1;
+
+		int64_t newRad = (int64_t)radI + sRad * dRad;
+		if (newRad < 0 || newRad >= (1ll << level)) {
+			continue;
+		}
+		int newLatBits = latitudeBits(level, (DimIndex)newRad);
+		int64_t newLat = rescale(latI, latBits, newLatBits, latFrac) + sLat * dLat;
+		if (newLat < 0 || newLat >= (1ll << newLatBits)) {
+			continue;
+		}
+		int newLngBits = longitudeBits(level, (DimIndex)newRad, (DimIndex)newLat);
+		int64_t newLng = rescale(lngI, lngBits, newLngBits, lngFrac) + sLng * dLng;
+		if (newLng < 0 || newLng >= (1ll << newLngBits)) {
+			continue;
+		}
+
+		cells[n] = coordinatesIndex(level, (DimIndex)newRad, (DimIndex)newLat, (DimIndex)newLng);
+		weights[n] = (sRad ? wRad : 1.0 - wRad) * (sLat ? wLat : 1.0 - wLat) * (sLng ? wLng : 1.0 - wLng);
+		n++;
+	}
+	return n;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "IndexOperations.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+// Sparse scalar field over level k cells. Cells are grouped into bricks of 8^brickLevels cells that share
+// an ancestor, and each brick's values are stored contiguously so neighbouring cells are usually in the same
+// brick. Bricks are created when a cell in them is first set and are found through a hash map of ancestors.
+class FieldStore {
+
+public:
+	FieldStore(const IndexOperations* io, int k, int brickLevels = 2);
+
+	void set(Index key, double value);
+	bool get(Index key, double& value) const;
+	bool contains(Index key) const;
+
+	size_t size() const;
+	size_t numBricks() const;
+	size_t memoryBytes() const;
+
+	// Value of the cell each point is in. found[i] is 0 when that cell has no value.
+	void sampleNearest(const std::vector<Point>& points, std::vector<double>& samples, std::vector<uint8_t>& found, unsigned int numThreads = 1) const;
+
+	// Trilinear interpolation between the point's cell and the 7 neighbours towards the point, weighted by the point's
+	// position in its cell. Across shell and zone boundaries the neighbour is the cell of the other resolution next to the point.
+	// Weights of cells without values are dropped and the rest renormalized, found[i] is 0 when none have values.
+	void sampleInterpolated(const std::vector<Point>& points, std::vector<double>& samples, std::vector<uint8_t>& found, unsigned int numThreads = 1) const;
+
+private:
+	const IndexOperations* io;
+	int k;
+	int brickLevels;
+	size_t brickCells;
+	size_t brickWords;
+	size_t count;
+
+	std::unordered_map<Index, uint32_t> bricks;
+	std::vector<double> values;
+	std::vector<uint64_t> present;
+
+	// Brick number of the brick holding key, -1 if there is none
+	int64_t findBrick(Index key) const;
+	bool get(int64_t brick, Index key, double& value) const;
+
+	int stencil(const Point& p, Index key, Index cells[8], double weights[8]) const;
+};
@@ -0,0 +1,249 @@
+#include "GridRemapper.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+
+// Source cells are enumerated from their ancestors at this level, one ancestor at a time per thread
+constexpr int ENUMERATION_LEVEL = 4;
+
+
+struct GridRemapper::Worker {
+	std::unordered_map<Index, Range> cache;
+	int cacheLevel = -1; // ranges of target cells up to this level go through the cache
+
+	std::vector<TargetCell> cells[2];
+	std::vector<std::vector<TargetCell>> frontiers; // remapAll, the refined target cells of the source cell walked at each level
+	std::vector<RemapWeight> weights;
+};
+
+
+// True if a and b share more than a face, bounds aren't clipped so this is only used to prune
+static bool overlaps(const Range& a, const Range& b) {
+	return a.radMin < b.radMax && b.radMin < a.radMax &&
+	       a.latMin < b.latMax && b.latMin < a.latMax &&
+	       a.lngMin < b.lngMax && b.lngMin < a.lngMax;
+}
+
+
+// Intersection of a and b clipped to the grid, false if it is thinner than tolerance times the extent of a in any coordinate
+static bool intersect(const Range& a, const Range& b, double tolerance, Range& o) {
+
+	o.radMin = std::max(std::max(a.radMin, b.radMin), 0.0);
+	o.radMax = std::min(std::min(a.radMax, b.radMax), GRID_RAD);
+	o.latMin = std::max(std::max(a.latMin, b.latMin), 0.0);
+	o.latMax = std::min(std::min(a.latMax, b.latMax), M_PI_2);
+	o.lngMin = std::max(std::max(a.lngMin, b.lngMin), 0.0);
+	o.lngMax = std::min(std::min(a.lngMax, b.lngMax), M_PI_2);
+
+	return o.radMax - o.radMin > tolerance * (a.radMax - a.radMin) &&
+	       o.latMax - o.latMin > tolerance * (a.latMax - a.latMin) &&
+	       o.lngMax - o.lngMin > tolerance * (a.lngMax - a.lngMin);
+}
+
+
+GridRemapper::GridRemapper(const IndexOperations* source, const IndexOperations* target, int targetLevel, size_t cacheBudget) :
+	source(source),
+	target(target),
+	targetLevel(targetLevel),
+	cacheEntries(std::max(cacheBudget / (sizeof(std::pair<const Index, Range>) + 2 * sizeof(void*)), (size_t)1))
+{
+	TargetCell root = { 1, target->indexToRange(1) };
+	roots.push_back(root);
+}
+
+
+std::vector<RemapWeight> GridRemapper::remap(Index sourceCell) const {
+
+	Worker w;
+	weigh(source->indexToRange(sourceCell), 0, roots, w);
+	return w.weights;
+}
+
+
+void GridRemapper::remap(const std::vector<Index>& sources, const RemapCallback& callback, unsigned int numThreads) const {
+
+	if (numThreads == 0) {
+		numThreads = defaultThreadCount();
+	}
+
+	parallelFor(sources.size(), numThreads, [&](size_t begin, size_t end, unsigned int t) {
+
+		Worker w;
+		for (size_t i = begin; i < end; i++) {
+
+			// Target level cells are only reused between source cells when the target is coarser
+			w.cacheLevel = (targetLevel < indexLevel(sources[i])) ? targetLevel : targetLevel - 1;
+			weigh(source->indexToRange(sources[i]), 0, roots, w);
+			callback(sources[i], w.weights, t);
+		}
+	});
+}
+
+
+void GridRemapper::remapAll(int sourceLevel, const RemapCallback& callback, unsigned int numThreads) const {
+
+	if (numThreads == 0) {
+		numThreads = defaultThreadCount();
+	}
+
+	// Ancestors are few enough to list, their descendants are walked depth first by each thread
+	int ancestorLevel = std::min(sourceLevel, ENUMERATION_LEVEL);
+	std::vector<Index> ancestors = { 1 };
+	for (int level = 0; level < ancestorLevel; level++) {
+
+		std::vector<Index> next;
+		for (Index cell : ancestors) {
+			Index children[8];
+			int numChildren = indexChildren(cell, children);
+			next.insert(next.end(), children, children + numChildren);
+		}
+		ancestors.swap(next);
+	}
+
+	parallelFor(ancestors.size(), numThreads, [&](size_t begin, size_t end, unsigned int t) {
+
+		// Every target cell is decoded at most once per source parent, so nothing is cached
+		Worker w;
+		w.frontiers.resize(sourceLevel + 1);
+		std::vector<std::pair<Index, int>> stack;
+
+		for (size_t i = begin; i < end; i++) {
+
+			stack.push_back(std::pair<Index, int>(ancestors[i], ancestorLevel));
+			while (!stack.empty()) {
+
+				std::pair<Index, int> cell = stack.back();
+				stack.pop_back();
+
+				Range range = source->indexToRange(cell.first);
+
+				// Ancestors start from the target root, other cells from the cells overlapping their parent.
+				// Entries of frontiers[level - 1] stay valid until the last child of that parent is done.
+				if (cell.second == sourceLevel) {
+					if (cell.second == ancestorLevel) {
+						weigh(range, 0, roots, w);
+					}
+					else {
+						weigh(range, cell.second, w.frontiers[cell.second - 1], w);
+					}
+					callback(cell.first, w.weights, t);
+					continue;
+				}
+
+				if (cell.second == ancestorLevel) {
+					w.frontiers[cell.second] = descend(range, 0, cell.second + 1, roots, w);
+				}
+				else {
+					refine(range, cell.second, w.frontiers[cell.second - 1], w.frontiers[cell.second], w);
+				}
+
+				// Pushed in reverse so cells come out in key order
+				Index children[8];
+				int numChildren = indexChildren(cell.first, children);
+				for (int c = numChildren - 1; c >= 0; c--) {
+					stack.push_back(std::pair<Index, int>(children[c], cell.second + 1));
+				}
+			}
+		}
+	});
+}
+
+
+double GridRemapper::volume(const Range& r) {
+
+	double radMin = std::max(r.radMin, 0.0);
+	double radMax = std::min(r.radMax, GRID_RAD);
+	double latMin = std::max(r.latMin, 0.0);
+	double latMax = std::min(r.latMax, M_PI_2);
+	double lngMin = std::max(r.lngMin, 0.0);
+	double lngMax = std::min(r.lngMax, M_PI_2);
+
+	if (radMax <= radMin || latMax <= latMin || lngMax <= lngMin) {
+		return 0.0;
+	}
+	return (radMax * radMax * radMax - radMin * radMin * radMin) / 3.0 * (sin(latMax) - sin(latMin)) * (lngMax - lngMin);
+}
+
+
+void GridRemapper::refine(const Range& bounds, int level, const std::vector<TargetCell>& cells, std::vector<TargetCell>& out, Worker& w) const {
+
+	out.clear();
+	for (const TargetCell& cell : cells) {
+
+		if (!overlaps(bounds, cell.range)) {
+			continue;
+		}
+		if (level >= targetLevel) {
+			out.push_back(cell);
+			continue;
+		}
+
+		Index children[8];
+		int numChildren = indexChildren(cell.index, children);
+		for (int c = 0; c < numChildren; c++) {
+
+			TargetCell child;
+			child.index = children[c];
+
+			if (level + 1 <= w.cacheLevel) {
+				std::unordered_map<Index, Range>::const_iterator it = w.cache.find(child.index);
+				if (it != w.cache.end()) {
+					child.range = it->second;
+				}
+				else {
+					// Cleared rather than evicted, the cells worth keeping come back within a few source cells
+					if (w.cache.size() >= cacheEntries) {
+						w.cache.clear();
+					}
+					child.range = target->indexToRange(child.index);
+					w.cache.emplace(child.index, child.range);
+				}
+			}
+			else {
+				child.range = target->indexToRange(child.index);
+			}
+
+			if (overlaps(bounds, child.range)) {
+				out.push_back(child);
+			}
+		}
+	}
+}
+
+
+const std::vector<GridRemapper::TargetCell>& GridRemapper::descend(const Range& bounds, int level, int toLevel,
+                                                                   const std::vector<TargetCell>& cells, Worker& w) const {
+
+	const std::vector<TargetCell>* current = &cells;
+	for (; level < toLevel; level++) {
+
+		std::vector<TargetCell>& next = (current == &w.cells[0]) ? w.cells[1] : w.cells[0];
+		refine(bounds, level, *current, next, w);
+		current = &next;
+	}
+	return *current;
+}
+
+
+void GridRemapper::weigh(const Range& sourceRange, int level, const std::vector<TargetCell>& cells, Worker& w) const {
+
+	w.weights.clear();
+
+	double sourceVolume = volume(sourceRange);
+	if (sourceVolume <= 0.0) {
+		return;
+	}
+
+	for (const TargetCell& cell : descend(sourceRange, level, targetLevel, cells, w)) {
+
+		Range overlap;
+		if (intersect(sourceRange, cell.range, FACE_TOLERANCE, overlap)) {
+			RemapWeight weight = { cell.index, volume(overlap) / sourceVolume };
+			w.weights.push_back(weight);
+		}
+	}
+}
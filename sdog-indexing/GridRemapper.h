@@ -0,0 +1,69 @@
+#pragma once
+
+#include "IndexOperations.h"
+
+#include <functional>
+#include <vector>
+
+
+struct RemapWeight {
+	Index target;
+	double fraction; // of the source cell's volume
+};
+
+
+// Called once per source cell with the target cells it overlaps, and the number of the worker thread that remapped it.
+// Thread numbers are below the numThreads passed in, or below defaultThreadCount() when that is 0.
+typedef std::function<void(Index, const std::vector<RemapWeight>&, unsigned int)> RemapCallback;
+
+
+// Maps cells of one grid onto the level k cells of another, which can be a different variant or level.
+// Target cells are found by descending the target hierarchy one level at a time, keeping only cells whose
+// bounds overlap the source cell. Both grids bound cells by radius, latitude and longitude, so the overlap
+// of two cells is another such box and its volume is exact.
+class GridRemapper {
+
+public:
+	// Cells given one at a time are each found by descending from the target root, so every thread keeps its own
+	// cache of up to cacheBudget bytes of target ranges above level k, which nearly every cell passes through.
+	GridRemapper(const IndexOperations* source, const IndexOperations* target, int targetLevel, size_t cacheBudget = 4 << 20);
+
+	std::vector<RemapWeight> remap(Index sourceCell) const;
+
+	// Remaps the given source cells across threads, results are passed to callback rather than stored
+	void remap(const std::vector<Index>& sources, const RemapCallback& callback, unsigned int numThreads = 0) const;
+
+	// Remaps every valid cell of the source grid at sourceLevel without listing them first. The source grid is
+	// walked depth first, each source cell carrying the target cells that overlap it so its children only test
+	// their descendants.
+	void remapAll(int sourceLevel, const RemapCallback& callback, unsigned int numThreads = 0) const;
+
+	// Volume of a cell with the given bounds, clipped to the grid
+	static double volume(const Range& r);
+
+	// Overlaps thinner than this fraction of the source cell in any coordinate are treated as shared faces
+	static constexpr double FACE_TOLERANCE = 1e-9;
+
+private:
+	struct TargetCell {
+		Index index;
+		Range range;
+	};
+
+	// Decoded target ranges and buffers owned by one thread
+	struct Worker;
+
+	const IndexOperations* source;
+	const IndexOperations* target;
+	int targetLevel;
+	size_t cacheEntries;
+	std::vector<TargetCell> roots;
+
+	// One level of descent: cells overlapping bounds are replaced by their children that overlap it, or only
+	// filtered once level reaches the target level. Cells are at level, or the target level if that is lower.
+	void refine(const Range& bounds, int level, const std::vector<TargetCell>& cells, std::vector<TargetCell>& out, Worker& w) const;
+	const std::vector<TargetCell>& descend(const Range& bounds, int level, int toLevel, const std::vector<TargetCell>& cells, Worker& w) const;
+
+	// Fills w.weights with the target cells under cells that overlap the source cell
+	void weigh(const Range& sourceRange, int level, const std::vector<TargetCell>& cells, Worker& w) const;
+};
@@ -0,0 +1,161 @@
+#include "IncrementalIndexer.h"
+
+#include "Parallel.h"
+
+
+void UpdateStats::add(UpdateResult result) {
+
+	if (result == UpdateResult::UNCHANGED) {
+		unchanged++;
+	}
+	else if (result == UpdateResult::NEIGHBOUR) {
+		neighbour++;
+	}
+	else {
+		reencoded++;
+	}
+}
+
+
+IncrementalIndexer::IncrementalIndexer(const IndexOperations* io, int k) :
+	io(io),
+	k(k)
+{}
+
+
+TrackedCell IncrementalIndexer::track(const Point& p) const {
+
+	TrackedCell cell;
+	cell.index = io->pointToIndex(p, k);
+	cell.range = io->indexToRange(cell.index);
+	return cell;
+}
+
+
+void IncrementalIndexer::trackAll(const std::vector<Point>& points, std::vector<TrackedCell>& cells, unsigned int numThreads) const {
+
+	cells.resize(points.size());
+	parallelFor(points.size(), numThreads, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t i = begin; i < end; i++) {
+			cells[i] = track(points[i]);
+		}
+	});
+}
+
+
+Index IncrementalIndexer::update(Index previous, Range& range, const Point& p) const {
+
+	TrackedCell cell = {previous, range};
+	update(cell, p);
+	range = cell.range;
+	return cell.index;
+}
+
+
+UpdateResult IncrementalIndexer::update(TrackedCell& cell, const Point& p) const {
+
+	if (inside(cell.range, p)) {
+		return UpdateResult::UNCHANGED;
+	}
+
+	Index candidate = neighbour(cell.index, cell.range, p);
+	if (candidate != 0) {
+
+		Range candidateRange = io->indexToRange(candidate);
+		if (inside(candidateRange, p)) {
+			cell.index = candidate;
+			cell.range = candidateRange;
+			return UpdateResult::NEIGHBOUR;
+		}
+	}
+
+	Index index = io->pointToIndex(p, k);
+	if (index == cell.index) {
+		return UpdateResult::UNCHANGED;
+	}
+	cell.index = index;
+	cell.range = io->indexToRange(index);
+	return UpdateResult::REENCODED;
+}
+
+
+UpdateStats IncrementalIndexer::updateAll(std::vector<TrackedCell>& cells, const std::vector<Point>& points, std::vector<size_t>& changed, unsigned int numThreads) const {
+
+	if (numThreads == 0) {
+		numThreads = defaultThreadCount();
+	}
+	std::vector<UpdateStats> threadStats(numThreads);
+	std::vector<std::vector<size_t>> threadChanged(numThreads);
+
+	parallelFor(cells.size(), numThreads, [&](size_t begin, size_t end, unsigned int t) {
+		for (size_t i = begin; i < end; i++) {
+
+			UpdateResult result = update(cells[i], points[i]);
+			threadStats[t].add(result);
+			if (result != UpdateResult::UNCHANGED) {
+				threadChanged[t].push_back(i);
+			}
+		}
+	});
+
+	// Chunks are contiguous and in thread order so concatenating keeps positions sorted
+	UpdateStats stats;
+	changed.clear();
+	for (unsigned int t = 0; t < numThreads; t++) {
+		stats.unchanged += threadStats[t].unchanged;
+		stats.neighbour += threadStats[t].neighbour;
+		stats.reencoded += threadStats[t].reencoded;
+		changed.insert(changed.end(), threadChanged[t].begin(), threadChanged[t].end());
+	}
+	return stats;
+}
+
+
+// Inside the range and not within the margin of any boundary. Decoded bounds can be a few ULPs
+// off from where the encoder splits, so points that close to a boundary are left to pointToIndex.
+bool IncrementalIndexer::inside(const Range& r, const Point& p) {
+	return p.rad > r.radMin + RAD_MARGIN && p.rad < r.radMax - RAD_MARGIN &&
+	       p.lat > r.latMin + ANGLE_MARGIN && p.lat < r.latMax - ANGLE_MARGIN &&
+	       p.lng > r.lngMin + ANGLE_MARGIN && p.lng < r.lngMax - ANGLE_MARGIN;
+}
+
+
+// Adjacent cell in the direction p left the range, 0 if p didn't leave or the neighbour has a different resolution.
+// All grids share the index layout, only the geometry of the splits differs, so adjacency is the same for all of them.
+Index IncrementalIndexer::neighbour(Index index, const Range& range, const Point& p) const {
+
+	int level;
+	DimIndex radI, latI, lngI;
+	indexCoordinates(index, level, radI, latI, lngI);
+
+	// radI counts inwards from the surface
+	int dRad = (p.rad > range.radMax) ? -1 : (p.rad <= range.radMin) ? 1 : 0;
+	int dLat = (p.lat >= range.latMax) ? 1 : (p.lat < range.latMin) ? -1 : 0;
+	int dLng = (p.lng >= range.lngMax) ? 1 : (p.lng < range.lngMin) ? -1 : 0;
+
+	if (dRad == 0 && dLat == 0 && dLng == 0) {
+		return 0;
+	}
+
+	int latBits = latitudeBits(level, radI);
+	int lngBits = longitudeBits(level, radI, latI);
+
+	// Moving out of the grid, or across a shell boundary where latitude resolution changes
+	int64_t newRad = (int64_t)radI + dRad;
+	if (newRad < 0 || newRad >= (1ll << level) || latitudeBits(level, (DimIndex)newRad) != latBits) {
+		return 0;
+	}
+
+	// Same for zone boundaries where longitude resolution changes
+	int64_t newLat = (int64_t)latI + dLat;
+	if (newLat < 0 || newLat >= (1ll << latBits) || longitudeBits(level, (DimIndex)newRad, (DimIndex)newLat) != lngBits) {
+		return 0;
+	}
+
+	int64_t newLng = (int64_t)lngI + dLng;
+	if (newLng < 0 || newLng >= (1ll << lngBits)) {
+		return 0;
+	}
+
+	return coordinatesIndex(level, (DimIndex)newRad, (DimIndex)newLat, (DimIndex)newLng);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "IndexOperations.h"
+
+#include <cstdint>
+#include <vector>
+
+
+// Index of a tracked object along with the bounds of its cell from the last update
+struct TrackedCell {
+	Index index;
+	Range range;
+};
+
+
+enum class UpdateResult {
+	UNCHANGED,  // still inside the cached cell
+	NEIGHBOUR,  // moved into an adjacent cell of the same level
+	REENCODED   // needed a full pointToIndex
+};
+
+
+struct UpdateStats {
+	uint64_t unchanged = 0;
+	uint64_t neighbour = 0;
+	uint64_t reencoded = 0;
+
+	uint64_t changed() const { return neighbour + reencoded; }
+	void add(UpdateResult result);
+};
+
+
+// Keeps the level k indices of moving objects up to date. A new position is first tested against the
+// cached bounds, then against the face, edge or corner neighbour it moved towards, and only encoded from
+// scratch when it moved further or crossed a change in resolution. Points within a small margin of a
+// cell boundary are always re-encoded so results match pointToIndex.
+class IncrementalIndexer {
+
+public:
+	IncrementalIndexer(const IndexOperations* io, int k);
+
+	TrackedCell track(const Point& p) const;
+	void trackAll(const std::vector<Point>& points, std::vector<TrackedCell>& cells, unsigned int numThreads = 1) const;
+
+	// Returns the index of p, range holds the bounds of previous on input and of the returned index on output
+	Index update(Index previous, Range& range, const Point& p) const;
+	UpdateResult update(TrackedCell& cell, const Point& p) const;
+
+	// Updates cells[i] with points[i] and writes the positions of cells whose index changed into changed, in order
+	UpdateStats updateAll(std::vector<TrackedCell>& cells, const std::vector<Point>& points, std::vector<size_t>& changed, unsigned int numThreads = 1) const;
+
+	static constexpr double RAD_MARGIN = 1e-9;
+	static constexpr double ANGLE_MARGIN = 1e-12;
+
+private:
+	const IndexOperations* io;
+	int k;
+
+	static bool inside(const Range& r, const Point& p);
+	Index neighbour(Index index, const Range& range, const Point& p) const;
+};
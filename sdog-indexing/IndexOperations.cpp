@@ -1,15 +1,54 @@
 #include "IndexOperations.h"
 
+#include "Instrumentation.h"
+
 #include <libmorton/morton.h>
 
 #include <algorithm>
 #include <cmath>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 
 double logB(double arg, double base) {
 	return log(arg) / log(base);
 }
 
+// Number of bits needed to represent v, 0 when v is 0
+static int bitWidth(uint64_t v) {
+#ifdef _MSC_VER
+	unsigned long i;
+	if (_BitScanReverse(&i, (unsigned long)(v >> 32))) {
+		return (int)i + 33;
+	}
+	return _BitScanReverse(&i, (unsigned long)v) ? (int)i + 1 : 0;
+#else
+	return v ? 64 - __builtin_clzll(v) : 0;
+#endif
+}
+
+
+// Fraction in [0, 1] to 32 bit fixed point, rounding down
+static uint32_t quantize(double frac) {
+	double scaled = floor(frac * 4294967296.0);
+	return (uint32_t)std::min(std::max(scaled, 0.0), 4294967295.0);
+}
+
+
+QuantizedPoint::QuantizedPoint(const Point& p) :
+	rad(quantize(p.rad / GRID_RAD)),
+	lat(quantize(p.lat / M_PI_2)),
+	lng(quantize(p.lng / M_PI_2))
+{}
+
+
+Point QuantizedPoint::toPoint() const {
+	return Point(GRID_RAD * (rad / 4294967296.0), M_PI_2 * (lat / 4294967296.0), M_PI_2 * (lng / 4294967296.0));
+}
+
+
 std::ostream& operator<<(std::ostream& os, const Point& p) {
 	os << p.rad << ", " << p.lat << ", " << p.lng;
 	return os;
@@ -24,6 +63,229 @@ std::ostream& operator<<(std::ostream& os, const Range& r) {
 }
 
 
+// Largest float <= d
+static float floatDown(double d) {
+	float f = (float)d;
+	return (f > d) ? nextafterf(f, -INFINITY) : f;
+}
+
+
+// Smallest float >= d
+static float floatUp(double d) {
+	float f = (float)d;
+	return (f < d) ? nextafterf(f, INFINITY) : f;
+}
+
+
+RangeF::RangeF(const Range& r) :
+	radMin(floatDown(r.radMin)),
+	radMax(floatUp(r.radMax)),
+	latMin(floatDown(r.latMin)),
+	latMax(floatUp(r.latMax)),
+	lngMin(floatDown(r.lngMin)),
+	lngMax(floatUp(r.lngMax))
+{}
+
+
+Range RangeF::toRange() const {
+	return Range(radMin, radMax, latMin, latMax, lngMin, lngMax);
+}
+
+
+double LazyRange::radMin() const {
+	int k; DimIndex radI, latI, lngI;
+	indexCoordinates(index, k, radI, latI, lngI);
+	return GRID_RAD * (1.0 - ((radI + 1.0) / (double)(1ll << k)));
+}
+
+
+double LazyRange::radMax() const {
+	int k; DimIndex radI, latI, lngI;
+	indexCoordinates(index, k, radI, latI, lngI);
+	return GRID_RAD * (1.0 - (radI / (double)(1ll << k)));
+}
+
+
+double LazyRange::latMin() const {
+	int k; DimIndex radI, latI, lngI;
+	indexCoordinates(index, k, radI, latI, lngI);
+	return M_PI_2 * (latI / (double)(1ll << latitudeBits(k, radI)));
+}
+
+
+double LazyRange::latMax() const {
+	int k; DimIndex radI, latI, lngI;
+	indexCoordinates(index, k, radI, latI, lngI);
+	return M_PI_2 * ((latI + 1.0) / (double)(1ll << latitudeBits(k, radI)));
+}
+
+
+double LazyRange::lngMin() const {
+	int k; DimIndex radI, latI, lngI;
+	indexCoordinates(index, k, radI, latI, lngI);
+	return M_PI_2 * (lngI / (double)(1ll << longitudeBits(k, radI, latI)));
+}
+
+
+double LazyRange::lngMax() const {
+	int k; DimIndex radI, latI, lngI;
+	indexCoordinates(index, k, radI, latI, lngI);
+	return M_PI_2 * ((lngI + 1.0) / (double)(1ll << longitudeBits(k, radI, latI)));
+}
+
+
+Range LazyRange::toRange() const {
+	return Range(radMin(), radMax(), latMin(), latMax(), lngMin(), lngMax());
+}
+
+
+Range LazyRange::toRange(const IndexOperations& io) const {
+	return io.indexToRange(index);
+}
+
+
+void indexCoordinates(Index index, int& k, DimIndex& radI, DimIndex& latI, DimIndex& lngI) {
+
+	int width = bitWidth(index) - 1;
+	k = width / 3;
+	libmorton::morton3D_64_decode(index ^ (1ll << width), lngI, latI, radI);
+}
+
+
+Index coordinatesIndex(int k, DimIndex radI, DimIndex latI, DimIndex lngI) {
+	return libmorton::morton3D_64_encode(lngI, latI, radI) + (1ll << (k * 3));
+}
+
+
+// Integer form of the shell calculation in EfficientOperations::indexToRange
+int latitudeBits(int k, DimIndex radI) {
+
+	// radMax is m / 2^k, which is in shell k - ceil(log2(m))
+	uint64_t m = (1ull << k) - radI;
+	int shell = k - bitWidth(m - 1);
+	return k - std::min(shell, k);
+}
+
+
+int longitudeBits(int k, DimIndex radI, DimIndex latI) {
+
+	int bits = latitudeBits(k, radI);
+
+	// 1 - latMin is m / 2^bits, which is in zone bits - ceil(log2(m))
+	uint64_t m = (1ull << bits) - latI;
+	int zone = bits - bitWidth(m - 1);
+	return std::max(bits - zone, 0);
+}
+
+
+int indexLevel(Index index) {
+
+	int width = 0;
+	while (index >>= 1) {
+		width++;
+	}
+	return width / 3;
+}
+
+
+SdogCellType indexCellType(Index index) {
+
+	int k = indexLevel(index);
+
+	// Follow codes from the root and track type changes the same way as SimpleOperations::indexToRange
+	SdogCellType type = SdogCellType::SG;
+	for (int i = k - 1; i >= 0; i--) {
+
+		DimIndex code = (index >> (i * 3)) & 7;
+
+		if (type == SdogCellType::SG) {
+			if (code == 0 || code == 1) {
+				type = SdogCellType::NG;
+			}
+			else if (code == 2) {
+				type = SdogCellType::LG;
+			}
+			else if (code != 4) {
+				return SdogCellType::INVALID;
+			}
+		}
+		else if (type == SdogCellType::LG) {
+			if (code == 0 || code == 1 || code == 4 || code == 5) {
+				type = SdogCellType::NG;
+			}
+			else if (code != 2 && code != 6) {
+				return SdogCellType::INVALID;
+			}
+		}
+		// all codes are valid for NG cells and type doesn't change
+	}
+	return type;
+}
+
+
+int indexChildren(Index index, Index children[8]) {
+
+	static const DimIndex sgCodes[] = { 0, 1, 2, 4 };
+	static const DimIndex lgCodes[] = { 0, 1, 2, 4, 5, 6 };
+	static const DimIndex ngCodes[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+	const DimIndex* codes;
+	int count;
+
+	SdogCellType type = indexCellType(index);
+	if (type == SdogCellType::SG) {
+		codes = sgCodes;
+		count = 4;
+	}
+	else if (type == SdogCellType::LG) {
+		codes = lgCodes;
+		count = 6;
+	}
+	else if (type == SdogCellType::NG) {
+		codes = ngCodes;
+		count = 8;
+	}
+	else {
+		return 0;
+	}
+
+	for (int i = 0; i < count; i++) {
+		children[i] = (index << 3) | codes[i];
+	}
+	return count;
+}
+
+
+void IndexOperations::pointsToIndices(const std::vector<Point>& points, int k, std::vector<Index>& indices) const {
+
+	SDOG_TIME_BATCH(Operation::POINTS_TO_INDICES);
+	indices.resize(points.size());
+	for (size_t i = 0; i < points.size(); i++) {
+		indices[i] = pointToIndex(points[i], k);
+	}
+}
+
+
+void IndexOperations::indicesToRanges(const std::vector<Index>& indices, std::vector<Range>& ranges) const {
+
+	SDOG_TIME_BATCH(Operation::INDICES_TO_RANGES);
+	ranges.resize(indices.size());
+	for (size_t i = 0; i < indices.size(); i++) {
+		ranges[i] = indexToRange(indices[i]);
+	}
+}
+
+
+void IndexOperations::indicesToRangesF(const std::vector<Index>& indices, std::vector<RangeF>& ranges) const {
+
+	SDOG_TIME_BATCH(Operation::INDICES_TO_RANGES_F);
+	ranges.resize(indices.size());
+	for (size_t i = 0; i < indices.size(); i++) {
+		ranges[i] = RangeF(indexToRange(indices[i]));
+	}
+}
+
+
 SimpleOperations::SimpleOperations() {
 
 	auto mid = [=](double max, double min, SdogCellType type) {
@@ -89,6 +351,9 @@ SimpleOperations::SimpleOperations(double radPower, double latScale) {
 
 Index SimpleOperations::pointToIndex(const Point& p, int k) const {
 
+	SDOG_TIME(Operation::SIMPLE_POINT_TO_INDEX);
+	SDOG_ENCODE_LEVEL(k);
+
 	Range r;
 	r.radMin = 0.0;
 	r.radMax = GRID_RAD;
@@ -104,6 +369,7 @@ Index SimpleOperations::pointToIndex(const Point& p, int k) const {
 	SdogCellType curType = SdogCellType::SG;
 	for (int i = 0; i < k; i++) {
 
+		SDOG_TRANSITION_FROM(curType);
 		unsigned int childCode = 0;
 		double radMid = radSplit(r.radMax, r.radMin, curType);
 		double latMid = latSplit(r.latMax, r.latMin, curType);
@@ -194,6 +460,7 @@ Index SimpleOperations::pointToIndex(const Point& p, int k) const {
 		}
 		index <<= 3;
 		index |= childCode;
+		SDOG_TRANSITION_TO(curType);
 	}
 	return index;
 }
@@ -201,6 +468,8 @@ Index SimpleOperations::pointToIndex(const Point& p, int k) const {
 
 Range SimpleOperations::indexToRange(Index index) const {
 
+	SDOG_TIME(Operation::SIMPLE_INDEX_TO_RANGE);
+
 	// Find width of index
 	Index copy = index;
 	int width = 0;
@@ -217,11 +486,13 @@ Range SimpleOperations::indexToRange(Index index) const {
 	r.lngMax = M_PI_2;
 
 	int k = width / 3;
+	SDOG_DECODE_LEVEL(k);
 
 	// Loop for each char in code and determine properties based on code
 	SdogCellType type = SdogCellType::SG;
 	for (int i = k - 1; i >= 0; i--) {
 
+		SDOG_TRANSITION_FROM(type);
 		DimIndex code = (index & (7ll << (i * 3))) >> (i * 3);
 
 		double radMid = radSplit(r.radMax, r.radMin, type);
@@ -346,6 +617,7 @@ Range SimpleOperations::indexToRange(Index index) const {
 				break;
 			}
 		}
+		SDOG_TRANSITION_TO(type);
 	}
 	return r;
 }
@@ -396,6 +668,9 @@ ModifiedEfficient::ModifiedEfficient(double radPower, double latScale) {
 
 Index EfficientOperations::pointToIndex(const Point& p, int k) const {
 
+	SDOG_TIME(Operation::EFFICIENT_POINT_TO_INDEX);
+	SDOG_ENCODE_LEVEL(k);
+
 	// Percentage distance in each coordinate
 	double radPerc = p.rad / GRID_RAD;
 	double latPerc = p.lat / M_PI_2;
@@ -419,8 +694,59 @@ Index EfficientOperations::pointToIndex(const Point& p, int k) const {
 }
 
 
+Index EfficientOperations::pointToIndex(const QuantizedPoint& p, int k) const {
+
+	SDOG_TIME(Operation::EFFICIENT_QUANTIZED_POINT_TO_INDEX);
+	SDOG_ENCODE_LEVEL(k);
+
+	// Fractions in (2^-(s+1), 2^-s] are in shell s, so for fixed point q shell = 32 - ceil(log2(q)).
+	// A radius of 0 is treated as the deepest shell.
+	uint64_t rad = p.rad;
+	int shell = 32 - bitWidth(rad - (rad != 0));
+
+	// Same for the distance to the pole, which can be a full 2^32 when lat is 0
+	uint64_t polar = (1ull << 32) - p.lat;
+	int zone = 32 - bitWidth(polar - 1);
+
+	// Modifiers to account for semiregular degenerate refinement
+	int latMod = std::min(shell, k);
+	int lngMod = std::min(latMod + zone, k);
+
+	// Index in each coordinate is the top bits of the fixed point fraction, the centre is clamped into the last cell
+	DimIndex radI = (DimIndex)std::min(((1ull << 32) - rad) >> (32 - k), (1ull << k) - 1);
+	DimIndex latI = (DimIndex)((uint64_t)p.lat >> (32 - k + latMod));
+	DimIndex lngI = (DimIndex)((uint64_t)p.lng >> (32 - k + lngMod));
+
+	// Interleave Morton Code and set 1 bit at beginning to mark start of index
+	return libmorton::morton3D_64_encode(lngI, latI, radI) + (1ll << (k * 3));
+}
+
+
+void EfficientOperations::quantizedPointsToIndices(const std::vector<QuantizedPoint>& points, int k, std::vector<Index>& indices) const {
+
+	SDOG_TIME_BATCH(Operation::QUANTIZED_POINTS_TO_INDICES);
+	indices.resize(points.size());
+	for (size_t i = 0; i < points.size(); i++) {
+		indices[i] = pointToIndex(points[i], k);
+	}
+}
+
+
+void EfficientOperations::indicesToLazyRanges(const std::vector<Index>& indices, std::vector<LazyRange>& ranges) const {
+
+	SDOG_TIME_BATCH(Operation::INDICES_TO_LAZY_RANGES);
+	ranges.resize(indices.size());
+	for (size_t i = 0; i < indices.size(); i++) {
+		ranges[i] = LazyRange(indices[i]);
+	}
+}
+
+
 Index ModifiedEfficient::pointToIndex(const Point& p, int k) const {
 
+	SDOG_TIME(Operation::MODIFIED_POINT_TO_INDEX);
+	SDOG_ENCODE_LEVEL(k);
+
 	// Percentage distance in each coordinate
 	double radPerc = p.rad / GRID_RAD;
 	double latPerc = sin(p.lat);
@@ -465,6 +791,8 @@ Index ModifiedEfficient::pointToIndex(const Point& p, int k) const {
 
 Range EfficientOperations::indexToRange(Index index) const {
 
+	SDOG_TIME(Operation::EFFICIENT_INDEX_TO_RANGE);
+
 	Range r;
 
 	// Find width of index
@@ -476,6 +804,7 @@ Range EfficientOperations::indexToRange(Index index) const {
 
 	// Refinement level is one third width
 	int k = width / 3;
+	SDOG_DECODE_LEVEL(k);
 
 	// Remove leading bit
 	index ^= 1ll << width;
@@ -516,6 +845,8 @@ Range EfficientOperations::indexToRange(Index index) const {
 
 Range ModifiedEfficient::indexToRange(Index index) const {
 
+	SDOG_TIME(Operation::MODIFIED_INDEX_TO_RANGE);
+
 	Range r;
 
 	// Find width of index
@@ -527,6 +858,7 @@ Range ModifiedEfficient::indexToRange(Index index) const {
 
 	// Refinement level is one third width
 	int k = width / 3;
+	SDOG_DECODE_LEVEL(k);
 
 	// Remove leading bit
 	index ^= 1ll << width;
@@ -573,11 +905,20 @@ Range ModifiedEfficient::indexToRange(Index index) const {
 	// Put bounds into coordinate domain as opposed to parameter
 	r.radMin = GRID_RAD * radInterpFunc(radUpp, radLow, radMinD);
 	r.radMax = GRID_RAD * radInterpFunc(radUpp, radLow, radMaxD);
-	if (r.radMin < 0.0 || isnan(r.radMin)) r.radMin = 0.0; // precision issues when min radius is 0
+	if (r.radMin < 0.0 || isnan(r.radMin)) { // precision issues when min radius is 0
+		r.radMin = 0.0;
+		SDOG_EVENT(Event::MODIFIED_RAD_CLAMP);
+	}
 
 	r.latMin = latInterpFunc(latUppP, latLowP, latMinD);
 	r.latMax = latInterpFunc(latUppP, latLowP, latMaxD);
-	if (isnan(r.latMax)) r.latMax = M_PI_2;
+	if (isnan(r.latMax)) {
+		r.latMax = M_PI_2;
+		SDOG_EVENT(Event::MODIFIED_LAT_CLAMP);
+	}
+	else if (r.latMax > M_PI_2) {
+		SDOG_EVENT(Event::MODIFIED_LAT_OVERFLOW);
+	}
 
 	r.lngMin *= M_PI_2;
 	r.lngMax *= M_PI_2;
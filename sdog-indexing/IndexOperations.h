@@ -1,9 +1,11 @@
 #pragma once
 
 #include <bitset>
+#include <cstdint>
 #include <functional>
 #include <iostream>
 #include <tuple>
+#include <vector>
 
 
 enum class SdogCellType {
@@ -41,6 +43,25 @@ struct Point {
 };
 
 
+// Point with each coordinate stored as a 32 bit fixed point fraction of its full extent:
+// rad of GRID_RAD, lat and lng of M_PI_2. The largest fraction is 1 - 2^-32.
+struct QuantizedPoint {
+	QuantizedPoint() = default;
+	QuantizedPoint(uint32_t rad, uint32_t lat, uint32_t lng) :
+		rad(rad),
+		lat(lat),
+		lng(lng)
+	{}
+	explicit QuantizedPoint(const Point& p);
+
+	Point toPoint() const;
+
+	uint32_t rad;
+	uint32_t lat;
+	uint32_t lng;
+};
+
+
 struct Range {
 	Range() = default;
 	Range(double radMin, double radMax, double latMin, double latMax, double lngMin, double lngMax) :
@@ -71,11 +92,78 @@ struct Range {
 };
 
 
+class IndexOperations;
+
+
+// Range narrowed to floats (24 bytes instead of 48). Bounds are rounded outwards so the
+// float range always contains the double range it was made from.
+struct RangeF {
+	RangeF() = default;
+	explicit RangeF(const Range& r);
+
+	Range toRange() const;
+
+	float radMin, radMax;
+	float latMin, latMax;
+	float lngMin, lngMax;
+};
+
+
+// Holds only an index (8 bytes) and computes bounds on demand. The accessors give bounds in the
+// EfficientOperations grid, use toRange with an IndexOperations for other grids.
+class LazyRange {
+
+public:
+	LazyRange() = default;
+	explicit LazyRange(Index index) :
+		index(index)
+	{}
+
+	Index getIndex() const { return index; }
+
+	double radMin() const;
+	double radMax() const;
+	double latMin() const;
+	double latMax() const;
+	double lngMin() const;
+	double lngMax() const;
+
+	Range toRange() const;
+	Range toRange(const IndexOperations& io) const;
+
+private:
+	Index index;
+};
+
+
+// Refinement level of an index (number of 3 bit codes after the leading 1 bit)
+int indexLevel(Index index);
+
+// Type of cell an index refers to, INVALID if the index contains a code not allowed for its parent's type
+SdogCellType indexCellType(Index index);
+
+// Writes the valid children of a cell into children and returns how many were written
+int indexChildren(Index index, Index children[8]);
+
+// Level and cell number in each coordinate of an index, in the layout written by EfficientOperations
+void indexCoordinates(Index index, int& k, DimIndex& radI, DimIndex& latI, DimIndex& lngI);
+Index coordinatesIndex(int k, DimIndex radI, DimIndex latI, DimIndex lngI);
+
+// Bits of latitude and longitude resolution of a level k cell, which are lower near the centre and pole
+int latitudeBits(int k, DimIndex radI);
+int longitudeBits(int k, DimIndex radI, DimIndex latI);
+
+
 class IndexOperations {
 
 public:
 	virtual Index pointToIndex(const Point& p, int k) const = 0;
 	virtual Range indexToRange(Index index) const = 0;
+
+	// Batched versions, outputs are resized to match the inputs
+	virtual void pointsToIndices(const std::vector<Point>& points, int k, std::vector<Index>& indices) const;
+	virtual void indicesToRanges(const std::vector<Index>& indices, std::vector<Range>& ranges) const;
+	virtual void indicesToRangesF(const std::vector<Index>& indices, std::vector<RangeF>& ranges) const;
 };
 
 
@@ -101,6 +189,12 @@ class EfficientOperations : public IndexOperations {
 public:
 	Index pointToIndex(const Point& p, int k) const;
 	Range indexToRange(Index index) const;
+
+	// Integer only encoding of fixed point input
+	Index pointToIndex(const QuantizedPoint& p, int k) const;
+	void quantizedPointsToIndices(const std::vector<QuantizedPoint>& points, int k, std::vector<Index>& indices) const;
+
+	void indicesToLazyRanges(const std::vector<Index>& indices, std::vector<LazyRange>& ranges) const;
 };
 
 
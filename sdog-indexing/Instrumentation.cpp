@@ -0,0 +1,344 @@
+#include "Instrumentation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+
+// Counters owned by one thread. Only the owner writes them, so increments are a relaxed load and store
+// instead of a locked add, while snapshots from other threads still read whole values.
+struct ThreadCounters {
+	std::atomic<uint64_t> calls[NUM_OPERATIONS] = {};
+	std::atomic<uint64_t> batchedCalls[NUM_OPERATIONS] = {};
+	std::atomic<uint64_t> nanoseconds[NUM_OPERATIONS] = {};
+	std::atomic<uint64_t> latency[NUM_OPERATIONS][NUM_LATENCY_BUCKETS] = {};
+	std::atomic<uint64_t> events[NUM_EVENTS] = {};
+	std::atomic<uint64_t> encodeLevels[NUM_LEVELS] = {};
+	std::atomic<uint64_t> decodeLevels[NUM_LEVELS] = {};
+	std::atomic<uint64_t> transitions[NUM_CELL_TYPES][NUM_CELL_TYPES] = {};
+};
+
+
+static void add(std::atomic<uint64_t>& counter, uint64_t value = 1) {
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+
+static void accumulate(InstrumentationSnapshot& s, const ThreadCounters& c) {
+
+	for (int o = 0; o < NUM_OPERATIONS; o++) {
+		s.calls[o] += c.calls[o].load(std::memory_order_relaxed);
+		s.batchedCalls[o] += c.batchedCalls[o].load(std::memory_order_relaxed);
+		s.nanoseconds[o] += c.nanoseconds[o].load(std::memory_order_relaxed);
+		for (int b = 0; b < NUM_LATENCY_BUCKETS; b++) {
+			s.latency[o][b] += c.latency[o][b].load(std::memory_order_relaxed);
+		}
+	}
+	for (int e = 0; e < NUM_EVENTS; e++) {
+		s.events[e] += c.events[e].load(std::memory_order_relaxed);
+	}
+	for (int l = 0; l < NUM_LEVELS; l++) {
+		s.encodeLevels[l] += c.encodeLevels[l].load(std::memory_order_relaxed);
+		s.decodeLevels[l] += c.decodeLevels[l].load(std::memory_order_relaxed);
+	}
+	for (int f = 0; f < NUM_CELL_TYPES; f++) {
+		for (int t = 0; t < NUM_CELL_TYPES; t++) {
+			s.transitions[f][t] += c.transitions[f][t].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+
+static void clear(ThreadCounters& c) {
+
+	for (int o = 0; o < NUM_OPERATIONS; o++) {
+		c.calls[o].store(0, std::memory_order_relaxed);
+		c.batchedCalls[o].store(0, std::memory_order_relaxed);
+		c.nanoseconds[o].store(0, std::memory_order_relaxed);
+		for (int b = 0; b < NUM_LATENCY_BUCKETS; b++) {
+			c.latency[o][b].store(0, std::memory_order_relaxed);
+		}
+	}
+	for (int e = 0; e < NUM_EVENTS; e++) {
+		c.events[e].store(0, std::memory_order_relaxed);
+	}
+	for (int l = 0; l < NUM_LEVELS; l++) {
+		c.encodeLevels[l].store(0, std::memory_order_relaxed);
+		c.decodeLevels[l].store(0, std::memory_order_relaxed);
+	}
+	for (int f = 0; f < NUM_CELL_TYPES; f++) {
+		for (int t = 0; t < NUM_CELL_TYPES; t++) {
+			c.transitions[f][t].store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+
+// Counters of every running thread that has recorded anything, and the totals of threads that have exited
+static std::mutex registryMutex;
+static std::vector<ThreadCounters*> registry;
+static InstrumentationSnapshot retired;
+
+
+thread_local bool InstrumentTimer::batchActive = false;
+
+
+// Owns a thread's counters. When the thread exits its counts are folded into the retired totals and the counters freed.
+struct LocalCounters {
+	ThreadCounters* counters = nullptr;
+
+	~LocalCounters() {
+
+		if (counters == nullptr) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(registryMutex);
+		accumulate(retired, *counters);
+		registry.erase(std::find(registry.begin(), registry.end(), counters));
+		delete counters;
+	}
+};
+
+
+static ThreadCounters& localCounters() {
+
+	thread_local LocalCounters local;
+	if (local.counters == nullptr) {
+		std::lock_guard<std::mutex> lock(registryMutex);
+		local.counters = new ThreadCounters();
+		registry.push_back(local.counters);
+	}
+	return *local.counters;
+}
+
+
+static int levelBucket(int level) {
+	return std::min(std::max(level, 0), NUM_LEVELS - 1);
+}
+
+
+InstrumentationSnapshot Instrumentation::snapshot() {
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	InstrumentationSnapshot s = retired;
+	for (const ThreadCounters* c : registry) {
+		accumulate(s, *c);
+	}
+	return s;
+}
+
+
+void Instrumentation::reset() {
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+
+	retired = InstrumentationSnapshot();
+	for (ThreadCounters* c : registry) {
+		clear(*c);
+	}
+}
+
+
+const char* Instrumentation::operationName(Operation op) {
+
+	switch (op) {
+	case Operation::SIMPLE_POINT_TO_INDEX: return "simplePointToIndex";
+	case Operation::SIMPLE_INDEX_TO_RANGE: return "simpleIndexToRange";
+	case Operation::EFFICIENT_POINT_TO_INDEX: return "efficientPointToIndex";
+	case Operation::EFFICIENT_QUANTIZED_POINT_TO_INDEX: return "efficientQuantizedPointToIndex";
+	case Operation::EFFICIENT_INDEX_TO_RANGE: return "efficientIndexToRange";
+	case Operation::MODIFIED_POINT_TO_INDEX: return "modifiedPointToIndex";
+	case Operation::MODIFIED_INDEX_TO_RANGE: return "modifiedIndexToRange";
+	case Operation::CACHED_INDEX_TO_RANGE: return "cachedIndexToRange";
+	case Operation::POINTS_TO_INDICES: return "pointsToIndices";
+	case Operation::INDICES_TO_RANGES: return "indicesToRanges";
+	case Operation::INDICES_TO_RANGES_F: return "indicesToRangesF";
+	case Operation::QUANTIZED_POINTS_TO_INDICES: return "quantizedPointsToIndices";
+	case Operation::INDICES_TO_LAZY_RANGES: return "indicesToLazyRanges";
+	case Operation::COUNT: break;
+	}
+	return "";
+}
+
+
+const char* Instrumentation::eventName(Event event) {
+
+	switch (event) {
+	case Event::MODIFIED_RAD_CLAMP: return "modifiedRadClamp";
+	case Event::MODIFIED_LAT_CLAMP: return "modifiedLatClamp";
+	case Event::MODIFIED_LAT_OVERFLOW: return "modifiedLatOverflow";
+	case Event::COUNT: break;
+	}
+	return "";
+}
+
+
+void Instrumentation::recordCall(Operation op, uint64_t nanoseconds) {
+
+	// Bucket is the bit width of the duration
+	int bucket = 0;
+	while (bucket < NUM_LATENCY_BUCKETS - 1 && (nanoseconds >> bucket) != 0) {
+		bucket++;
+	}
+
+	ThreadCounters& c = localCounters();
+	add(c.calls[(int)op]);
+	add(c.nanoseconds[(int)op], nanoseconds);
+	add(c.latency[(int)op][bucket]);
+}
+
+
+void Instrumentation::countBatchedCall(Operation op) {
+
+	ThreadCounters& c = localCounters();
+	add(c.calls[(int)op]);
+	add(c.batchedCalls[(int)op]);
+}
+
+
+void Instrumentation::countEvent(Event event) {
+	add(localCounters().events[(int)event]);
+}
+
+
+void Instrumentation::countEncodeLevel(int level) {
+	add(localCounters().encodeLevels[levelBucket(level)]);
+}
+
+
+void Instrumentation::countDecodeLevel(int level) {
+	add(localCounters().decodeLevels[levelBucket(level)]);
+}
+
+
+void Instrumentation::countTransition(SdogCellType from, SdogCellType to) {
+
+	if (from == SdogCellType::INVALID || to == SdogCellType::INVALID) {
+		return;
+	}
+	add(localCounters().transitions[(int)from][(int)to]);
+}
+
+
+double InstrumentationSnapshot::percentile(Operation op, double fraction) const {
+
+	uint64_t total = calls[(int)op] - batchedCalls[(int)op];
+	if (total == 0) {
+		return 0.0;
+	}
+
+	uint64_t target = (uint64_t)(fraction * total);
+	uint64_t seen = 0;
+	for (int b = 0; b < NUM_LATENCY_BUCKETS; b++) {
+		seen += latency[(int)op][b];
+		if (seen > target || seen == total) {
+			return (double)(1ull << b);
+		}
+	}
+	return (double)(1ull << (NUM_LATENCY_BUCKETS - 1));
+}
+
+
+static const char* cellTypeName(int type) {
+	const char* names[NUM_CELL_TYPES] = { "SG", "LG", "NG" };
+	return names[type];
+}
+
+
+void InstrumentationSnapshot::print(std::ostream& os) const {
+
+	os << "operation                              calls     batched     mean ns      p50 ns      p99 ns" << std::endl;
+	for (int o = 0; o < NUM_OPERATIONS; o++) {
+
+		if (calls[o] == 0) {
+			continue;
+		}
+		Operation op = (Operation)o;
+		os.width(32);
+		os << std::left << Instrumentation::operationName(op) << std::right;
+		os.width(12);
+		os << calls[o];
+		os.width(12);
+		os << batchedCalls[o];
+		os.width(12);
+		uint64_t timed = calls[o] - batchedCalls[o];
+		os << ((timed == 0) ? 0 : nanoseconds[o] / timed);
+		os.width(12);
+		os << (uint64_t)percentile(op, 0.5);
+		os.width(12);
+		os << (uint64_t)percentile(op, 0.99) << std::endl;
+	}
+
+	os << "encode levels:";
+	for (int l = 0; l < NUM_LEVELS; l++) {
+		if (encodeLevels[l] > 0) {
+			os << " " << l << ":" << encodeLevels[l];
+		}
+	}
+	os << std::endl << "decode levels:";
+	for (int l = 0; l < NUM_LEVELS; l++) {
+		if (decodeLevels[l] > 0) {
+			os << " " << l << ":" << decodeLevels[l];
+		}
+	}
+	os << std::endl << "simple transitions:";
+	for (int f = 0; f < NUM_CELL_TYPES; f++) {
+		for (int t = 0; t < NUM_CELL_TYPES; t++) {
+			if (transitions[f][t] > 0) {
+				os << " " << cellTypeName(f) << "->" << cellTypeName(t) << ":" << transitions[f][t];
+			}
+		}
+	}
+	os << std::endl << "events:";
+	for (int e = 0; e < NUM_EVENTS; e++) {
+		os << " " << Instrumentation::eventName((Event)e) << ":" << events[e];
+	}
+	os << std::endl;
+}
+
+
+void InstrumentationSnapshot::writeJson(std::ostream& os) const {
+
+	os << "{" << std::endl << "  \"operations\": {";
+	bool first = true;
+	for (int o = 0; o < NUM_OPERATIONS; o++) {
+
+		if (calls[o] == 0) {
+			continue;
+		}
+		os << (first ? "" : ",") << std::endl;
+		first = false;
+
+		os << "    \"" << Instrumentation::operationName((Operation)o) << "\": {\"calls\": " << calls[o] << ", \"batched\": " << batchedCalls[o];
+		os << ", \"nanoseconds\": " << nanoseconds[o] << ", \"latencyLog2\": [";
+		for (int b = 0; b < NUM_LATENCY_BUCKETS; b++) {
+			os << (b ? ", " : "") << latency[o][b];
+		}
+		os << "]}";
+	}
+	os << std::endl << "  }," << std::endl;
+
+	os << "  \"encodeLevels\": [";
+	for (int l = 0; l < NUM_LEVELS; l++) {
+		os << (l ? ", " : "") << encodeLevels[l];
+	}
+	os << "]," << std::endl << "  \"decodeLevels\": [";
+	for (int l = 0; l < NUM_LEVELS; l++) {
+		os << (l ? ", " : "") << decodeLevels[l];
+	}
+	os << "]," << std::endl << "  \"transitions\": {";
+	first = true;
+	for (int f = 0; f < NUM_CELL_TYPES; f++) {
+		for (int t = 0; t < NUM_CELL_TYPES; t++) {
+			os << (first ? "" : ", ") << "\"" << cellTypeName(f) << "->" << cellTypeName(t) << "\": " << transitions[f][t];
+			first = false;
+		}
+	}
+	os << "}," << std::endl << "  \"events\": {";
+	for (int e = 0; e < NUM_EVENTS; e++) {
+		os << (e ? ", " : "") << "\"" << Instrumentation::eventName((Event)e) << "\": " << events[e];
+	}
+	os << "}" << std::endl << "}" << std::endl;
+}
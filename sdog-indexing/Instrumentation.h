@@ -0,0 +1,156 @@
+#pragma once
+
+#include "IndexOperations.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+
+// Instrumentation is compiled in by defining SDOG_INSTRUMENT for the whole project. Without it the macros
+// below expand to nothing and the encoders and decoders are unchanged, snapshots are then all zeros.
+
+
+enum class Operation {
+	SIMPLE_POINT_TO_INDEX,
+	SIMPLE_INDEX_TO_RANGE,
+	EFFICIENT_POINT_TO_INDEX,
+	EFFICIENT_QUANTIZED_POINT_TO_INDEX,
+	EFFICIENT_INDEX_TO_RANGE,
+	MODIFIED_POINT_TO_INDEX,
+	MODIFIED_INDEX_TO_RANGE,
+	CACHED_INDEX_TO_RANGE,
+	POINTS_TO_INDICES,
+	INDICES_TO_RANGES,
+	INDICES_TO_RANGES_F,
+	QUANTIZED_POINTS_TO_INDICES,
+	INDICES_TO_LAZY_RANGES,
+	COUNT
+};
+
+
+enum class Event {
+	MODIFIED_RAD_CLAMP,   // ModifiedEfficient::indexToRange clamped a negative or NaN radMin to 0
+	MODIFIED_LAT_CLAMP,   // ModifiedEfficient::indexToRange clamped a NaN latMax to pi / 2
+	MODIFIED_LAT_OVERFLOW, // ModifiedEfficient::indexToRange returned a latMax above pi / 2
+	COUNT
+};
+
+
+constexpr int NUM_OPERATIONS = (int)Operation::COUNT;
+constexpr int NUM_EVENTS = (int)Event::COUNT;
+constexpr int NUM_LEVELS = INDEX_WIDTH / 3 + 1;
+constexpr int NUM_CELL_TYPES = 3;     // SG, LG and NG
+constexpr int NUM_LATENCY_BUCKETS = 40; // bucket b holds calls taking [2^(b-1), 2^b) ns, the last is open ended
+
+
+// Totals across all threads at one point in time
+struct InstrumentationSnapshot {
+	uint64_t calls[NUM_OPERATIONS] = {};
+	uint64_t batchedCalls[NUM_OPERATIONS] = {}; // part of calls made inside a batch API, these aren't timed
+	uint64_t nanoseconds[NUM_OPERATIONS] = {};
+	uint64_t latency[NUM_OPERATIONS][NUM_LATENCY_BUCKETS] = {};
+	uint64_t events[NUM_EVENTS] = {};
+
+	// Level of the index produced by each encode and consumed by each decode
+	uint64_t encodeLevels[NUM_LEVELS] = {};
+	uint64_t decodeLevels[NUM_LEVELS] = {};
+
+	// Refinement steps taken by SimpleOperations from a cell of one type to a child of another, both directions
+	uint64_t transitions[NUM_CELL_TYPES][NUM_CELL_TYPES] = {};
+
+	// Upper bound in ns of the bucket holding the given fraction of timed calls, 0 if there were none
+	double percentile(Operation op, double fraction) const;
+
+	void print(std::ostream& os) const;
+	void writeJson(std::ostream& os) const;
+};
+
+
+class Instrumentation {
+
+public:
+	static constexpr bool enabled() {
+#ifdef SDOG_INSTRUMENT
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	static InstrumentationSnapshot snapshot();
+
+	// Counts made by other threads while resetting may survive
+	static void reset();
+
+	static const char* operationName(Operation op);
+	static const char* eventName(Event event);
+
+	// Used through the macros below
+	static void recordCall(Operation op, uint64_t nanoseconds);
+	static void countBatchedCall(Operation op);
+	static void countEvent(Event event);
+	static void countEncodeLevel(int level);
+	static void countDecodeLevel(int level);
+	static void countTransition(SdogCellType from, SdogCellType to);
+};
+
+
+// Records the time from construction to destruction as one call. Within a batch timer, the timers of the per element
+// operations it calls on the same thread only count their calls, so a batch reads the clock once rather than once per element.
+class InstrumentTimer {
+
+public:
+	InstrumentTimer(Operation op, bool batch = false) :
+		op(op),
+		batch(batch),
+		suppressed(batchActive)
+	{
+		if (batch) {
+			batchActive = true;
+		}
+		if (!suppressed) {
+			start = std::chrono::steady_clock::now();
+		}
+	}
+
+	~InstrumentTimer() {
+		if (batch) {
+			batchActive = suppressed;
+		}
+		if (suppressed) {
+			Instrumentation::countBatchedCall(op);
+		}
+		else {
+			std::chrono::steady_clock::duration d = std::chrono::steady_clock::now() - start;
+			Instrumentation::recordCall(op, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+		}
+	}
+
+private:
+	Operation op;
+	bool batch;
+	bool suppressed; // a batch was already being timed on this thread, only the call is counted
+	std::chrono::steady_clock::time_point start;
+
+	static thread_local bool batchActive;
+};
+
+
+#ifdef SDOG_INSTRUMENT
+#define SDOG_TIME(op) InstrumentTimer sdogTimer(op)
+#define SDOG_TIME_BATCH(op) InstrumentTimer sdogTimer(op, true)
+#define SDOG_EVENT(event) Instrumentation::countEvent(event)
+#define SDOG_ENCODE_LEVEL(level) Instrumentation::countEncodeLevel(level)
+#define SDOG_DECODE_LEVEL(level) Instrumentation::countDecodeLevel(level)
+#define SDOG_TRANSITION_FROM(type) SdogCellType sdogFromType = (type)
+#define SDOG_TRANSITION_TO(type) Instrumentation::countTransition(sdogFromType, (type))
+#else
+#define SDOG_TIME(op)
+#define SDOG_TIME_BATCH(op)
+#define SDOG_EVENT(event)
+#define SDOG_ENCODE_LEVEL(level)
+#define SDOG_DECODE_LEVEL(level)
+#define SDOG_TRANSITION_FROM(type)
+#define SDOG_TRANSITION_TO(type)
+#endif
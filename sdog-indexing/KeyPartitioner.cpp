@@ -0,0 +1,127 @@
+#include "KeyPartitioner.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <random>
+
+
+KeyPartitioner::KeyPartitioner(int numShards, int alignLevel) :
+	numShards(std::max(numShards, 1)),
+	alignLevel(alignLevel)
+{}
+
+
+void KeyPartitioner::build(const std::vector<Point>& points, int k, const IndexOperations* io, size_t sampleSize, unsigned int seed) {
+
+	std::vector<Point> sample;
+	if (sampleSize >= points.size()) {
+		sample = points;
+	}
+	else {
+		std::mt19937 eng(seed);
+		std::uniform_int_distribution<size_t> dist(0, points.size() - 1);
+
+		sample.reserve(sampleSize);
+		for (size_t i = 0; i < sampleSize; i++) {
+			sample.push_back(points[dist(eng)]);
+		}
+	}
+
+	std::vector<Index> keys;
+	io->pointsToIndices(sample, k, keys);
+	buildFromKeys(std::move(keys), k);
+}
+
+
+void KeyPartitioner::buildFromKeys(std::vector<Index> keys, int k) {
+
+	splitters.clear();
+	if (keys.empty()) {
+		return;
+	}
+	std::sort(keys.begin(), keys.end());
+
+	// Keys below the level k leading bit can't occur, so rounding to a cell start never goes past it
+	int shift = 3 * std::max(k - alignLevel, 0);
+
+	for (int s = 1; s < numShards; s++) {
+
+		Index key = keys[(keys.size() * s) / numShards];
+		Index split = (key >> shift) << shift;
+
+		// Skewed samples can round several quantiles to the same cell
+		if (splitters.empty() || split > splitters.back()) {
+			splitters.push_back(split);
+		}
+	}
+
+	// A split at the first possible key would leave shard 0 empty
+	Index first = (Index)1 << (3 * k);
+	if (!splitters.empty() && splitters.front() <= first) {
+		splitters.erase(splitters.begin());
+	}
+}
+
+
+// Number of splitters <= key. The loop count only depends on the number of splitters and the
+// comparison compiles to a conditional move so there are no mispredicted branches.
+int KeyPartitioner::shardOf(Index key) const {
+
+	if (splitters.empty()) {
+		return 0;
+	}
+
+	const Index* base = splitters.data();
+	size_t n = splitters.size();
+	while (n > 1) {
+		size_t half = n / 2;
+		base = (base[half] <= key) ? base + half : base;
+		n -= half;
+	}
+	return (int)(base - splitters.data()) + (*base <= key);
+}
+
+
+void KeyPartitioner::shardsOf(const std::vector<Index>& keys, std::vector<int>& shards) const {
+
+	shards.resize(keys.size());
+	for (size_t i = 0; i < keys.size(); i++) {
+		shards[i] = shardOf(keys[i]);
+	}
+}
+
+
+std::vector<size_t> KeyPartitioner::simulate(const std::vector<Index>& keys, unsigned int numThreads) const {
+
+	if (numThreads == 0) {
+		numThreads = defaultThreadCount();
+	}
+
+	// Each thread acts as an ingestion front end with its own counts for every node
+	std::vector<std::vector<size_t>> threadCounts(numThreads, std::vector<size_t>(numShards, 0));
+	parallelFor(keys.size(), numThreads, [&](size_t begin, size_t end, unsigned int t) {
+		std::vector<size_t>& counts = threadCounts[t];
+		for (size_t i = begin; i < end; i++) {
+			counts[shardOf(keys[i])]++;
+		}
+	});
+
+	std::vector<size_t> counts(numShards, 0);
+	for (const std::vector<size_t>& c : threadCounts) {
+		for (int s = 0; s < numShards; s++) {
+			counts[s] += c[s];
+		}
+	}
+	return counts;
+}
+
+
+const std::vector<Index>& KeyPartitioner::getSplitters() const {
+	return splitters;
+}
+
+
+int KeyPartitioner::getNumShards() const {
+	return numShards;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "IndexOperations.h"
+
+#include <vector>
+
+
+// Splits the level k index space into shards with roughly equal numbers of keys. Split points are
+// chosen from a sample of keys and rounded down to the start of a cell at alignLevel so a shard
+// never splits a cell at that level.
+class KeyPartitioner {
+
+public:
+	KeyPartitioner(int numShards, int alignLevel);
+
+	// Encodes a random sample of points at level k and chooses split points from it
+	void build(const std::vector<Point>& points, int k, const IndexOperations* io, size_t sampleSize, unsigned int seed = 0);
+
+	// Chooses split points from level k keys that have already been sampled
+	void buildFromKeys(std::vector<Index> keys, int k);
+
+	// Shard a level k key belongs to
+	int shardOf(Index key) const;
+	void shardsOf(const std::vector<Index>& keys, std::vector<int>& shards) const;
+
+	// Routes keys to simulated nodes and returns how many each node received
+	std::vector<size_t> simulate(const std::vector<Index>& keys, unsigned int numThreads = 0) const;
+
+	// First key of each shard after shard 0, may be fewer than numShards - 1 if the sample is too small
+	const std::vector<Index>& getSplitters() const;
+	int getNumShards() const;
+
+private:
+	int numShards;
+	int alignLevel;
+
+	std::vector<Index> splitters;
+};
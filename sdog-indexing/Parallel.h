@@ -0,0 +1,42 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+
+// Number of worker threads to use when 0 is requested
+inline unsigned int defaultThreadCount() {
+	unsigned int n = std::thread::hardware_concurrency();
+	return (n == 0) ? 1 : n;
+}
+
+
+// Splits [0, n) into contiguous chunks and calls func(begin, end, thread) for each chunk on its own thread.
+// Chunks are deterministic for a given n and numThreads. With one thread func runs on the calling thread.
+template <typename Func>
+void parallelFor(size_t n, unsigned int numThreads, Func func) {
+
+	if (numThreads == 0) {
+		numThreads = defaultThreadCount();
+	}
+	numThreads = (unsigned int)std::max((size_t)1, std::min((size_t)numThreads, n));
+
+	if (numThreads == 1) {
+		func((size_t)0, n, 0u);
+		return;
+	}
+
+	size_t chunk = (n + numThreads - 1) / numThreads;
+
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < numThreads; t++) {
+
+		size_t begin = std::min(n, t * chunk);
+		size_t end = std::min(n, begin + chunk);
+		threads.emplace_back(func, begin, end, t);
+	}
+	for (std::thread& t : threads) {
+		t.join();
+	}
+}
@@ -1,13 +1,18 @@
 #include "Program.h"
 
+#include "Parallel.h"
+
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <random>
 
 
-void Program::testOperations(int n, int k) {
+void Program::testOperations(int n, int k, Distribution distribution) {
 
-	std::vector<Point> points = generateRandomPoints(n);
+	std::vector<Point> points = generateRandomPoints(n, distribution);
 	std::vector<Index> indices = generateIndicesFromPoints(points, k);
 
 	SimpleOperations simple;
@@ -15,7 +20,7 @@ void Program::testOperations(int n, int k) {
 	EfficientOperations efficient;
 	ModifiedEfficient efficientVol(1.7, 1.45);
 
-	std::cout << "testing " << n << " times at k = " << k << std::endl;
+	std::cout << "testing " << n << " " << WorkloadGenerator::distributionName(distribution) << " points at k = " << k << std::endl;
 
 	int numPtoIErrors = comparePointToIndex(points, k, &simple, &efficient, false);
 	std::cout << "PtoI non errors: " << numPtoIErrors << std::endl;
@@ -34,9 +39,34 @@ void Program::testOperations(int n, int k) {
 }
 
 
-void Program::benchmarkAll(int n, int maxK) {
+void Program::testDifferential(uint64_t n, int k, unsigned int numThreads) {
+
+	SimpleOperations simple;
+	SimpleOperations simpleVol(1.7, 1.45);
+	EfficientOperations efficient;
+	ModifiedEfficient efficientVol(1.7, 1.45);
+
+	DifferentialTester nonTester(&simple, &efficient, numThreads);
+	DifferentialTester volTester(&simpleVol, &efficientVol, numThreads);
+
+	for (DifferentialTester* tester : { &nonTester, &volTester }) {
+
+		std::cout << ((tester == &nonTester) ? "non" : "vol") << " random " << n << " points at k = " << k << std::endl;
+		tester->testRandom(n, k, Distribution::VOLUME_UNIFORM, nextSeed++).print(std::cout);
+
+		std::cout << ((tester == &nonTester) ? "non" : "vol") << " boundaries at k = " << k << std::endl;
+		tester->testBoundaries(k, 2).print(std::cout);
+
+		int allK = std::min(k, 6);
+		std::cout << ((tester == &nonTester) ? "non" : "vol") << " all indices at k = " << allK << std::endl;
+		tester->testAllIndices(allK).print(std::cout);
+	}
+}
+
+
+void Program::benchmarkAll(int n, int maxK, const std::string& fileName) {
 
-	std::ofstream out("1mil-run2.csv");
+	std::ofstream out(fileName);
 	out << "Efficient PtoI,Efficient Volume PtoI,Efficient Mapped PtoI,Simple PtoI,Simple Volume PtoI,Simple Mapped PtoI,";
 	out << "Efficient ItoR,Efficient Volume ItoR,Efficient Mapped ItoR,Simple ItoR,Simple Volume ItoR,Simple Mapped ItoR" << std::endl;
 
@@ -48,12 +78,14 @@ void Program::benchmarkAll(int n, int maxK) {
 	ModifiedEfficient efficientMap(2.0, 1.45);
 
 
-	std::vector<Point> points = generateRandomPoints(n);
+	// Timed loops read the structure of arrays buffer directly
+	PointBuffer points;
+	WorkloadGenerator(Distribution::PARAMETER_UNIFORM, nextSeed++).generate(n, points);
 
 	// warm up cache
 	for (int k = 15; k <= 17; k++) {
 
-		std::vector<Index> indices = generateIndicesFromPoints(points, k);
+		std::vector<Index> indices = generateIndicesFromPoints(points.toPoints(), k);
 
 		timePointToIndex(points, k, &efficient);
 		timePointToIndex(points, k, &efficientVol);
@@ -72,7 +104,7 @@ void Program::benchmarkAll(int n, int maxK) {
 
 	for (int k = 1; k <= maxK; k++) {
 
-		std::vector<Index> indices = generateIndicesFromPoints(points, k);
+		std::vector<Index> indices = generateIndicesFromPoints(points.toPoints(), k);
 		std::cout << "starting " << k << "...";
 
 		out << timePointToIndex(points, k, &efficient) << ",";
@@ -84,10 +116,10 @@ void Program::benchmarkAll(int n, int maxK) {
 
 		out << timeIndexToRange(indices, &efficient) << ",";
 		out << timeIndexToRange(indices, &efficientVol) << ",";
-		out << timeIndexToRange(indices, &efficientMap) << std::endl;
+		out << timeIndexToRange(indices, &efficientMap) << ",";
 		out << timeIndexToRange(indices, &simple) << ",";
 		out << timeIndexToRange(indices, &simpleVol) << ",";
-		out << timeIndexToRange(indices, &simpleMap) << ",";
+		out << timeIndexToRange(indices, &simpleMap) << std::endl;
 
 		std::cout << " done" << std::endl;
 	}
@@ -96,6 +128,478 @@ void Program::benchmarkAll(int n, int maxK) {
 }
 
 
+void Program::benchmarkCache(int n, int k, size_t memoryBudget) {
+
+	ModifiedEfficient efficientVol(1.7, 1.45);
+	CachedOperations cached(&efficientVol, memoryBudget);
+
+	// Most lookups go to a small set of popular cells
+	std::vector<Index> cells = generateRandomIndices(std::max(n / 100, 1), k);
+	std::vector<Index> rare = generateRandomIndices(n, k);
+
+	std::mt19937 eng(1);
+	std::uniform_real_distribution<> popularDist(0.0, 1.0);
+	std::uniform_int_distribution<size_t> cellDist(0, cells.size() - 1);
+
+	std::vector<Index> indices;
+	for (int i = 0; i < n; i++) {
+		indices.push_back((popularDist(eng) < 0.8) ? cells[cellDist(eng)] : rare[i]);
+	}
+
+	std::cout << "cache benchmark " << n << " lookups at k = " << k << ", capacity " << cached.getCapacity() << std::endl;
+
+	int errors = compareIndexToRange(indices, &efficientVol, &cached, false);
+	cached.clear();
+	cached.resetStats();
+
+	double uncachedTime = timeIndexToRange(indices, &efficientVol);
+	double cachedTime = timeIndexToRange(indices, &cached);
+	CacheStats stats = cached.getStats();
+
+	std::cout << "errors: " << errors << std::endl;
+	std::cout << "uncached: " << uncachedTime << " s, cached: " << cachedTime << " s" << std::endl;
+	std::cout << "hit rate: " << stats.hitRate() << ", evictions: " << stats.evictions << std::endl;
+}
+
+
+void Program::testQuantized(int n, int k) {
+
+	std::vector<Point> points = generateRandomPoints(n);
+
+	// Compare against the floating point encoder on the exact values the fixed point input represents.
+	// At high k a few points land exactly on a cell boundary, where the double path can round either way.
+	std::vector<QuantizedPoint> quantized;
+	for (Point& p : points) {
+		quantized.push_back(QuantizedPoint(p));
+		p = quantized.back().toPoint();
+	}
+
+	EfficientOperations efficient;
+	std::vector<Index> indices;
+	std::vector<Index> quantizedIndices;
+
+	std::cout << "testing " << n << " quantized points at k = " << k << std::endl;
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	efficient.pointsToIndices(points, k, indices);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	efficient.quantizedPointsToIndices(quantized, k, quantizedIndices);
+	std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+	int errorCount = 0;
+	for (size_t i = 0; i < points.size(); i++) {
+		if (indices[i] != quantizedIndices[i]) {
+			errorCount++;
+		}
+	}
+
+	std::cout << "errors: " << errorCount << std::endl;
+	std::cout << "double: " << std::chrono::duration<double>(t1 - t0).count() << " s, ";
+	std::cout << "quantized: " << std::chrono::duration<double>(t2 - t1).count() << " s" << std::endl;
+}
+
+
+void Program::benchmarkCompactRanges(int n, int k) {
+
+	std::vector<Index> indices = generateRandomIndices(n, k);
+
+	EfficientOperations efficient;
+	std::vector<Range> ranges;
+	std::vector<RangeF> rangesF;
+	std::vector<LazyRange> lazyRanges;
+
+	std::cout << "decoding " << n << " ranges at k = " << k << std::endl;
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	efficient.indicesToRanges(indices, ranges);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	efficient.indicesToRangesF(indices, rangesF);
+	std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+	efficient.indicesToLazyRanges(indices, lazyRanges);
+	std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+
+	// Float ranges must contain the full ranges and lazy ranges must match exactly
+	int floatErrors = 0;
+	int lazyErrors = 0;
+	for (int i = 0; i < n; i++) {
+
+		const Range& r = ranges[i];
+		const RangeF& f = rangesF[i];
+		Range l = lazyRanges[i].toRange();
+
+		if (f.radMin > r.radMin || f.radMax < r.radMax || f.latMin > r.latMin || f.latMax < r.latMax || f.lngMin > r.lngMin || f.lngMax < r.lngMax) {
+			floatErrors++;
+		}
+		if (l.radMin != r.radMin || l.radMax != r.radMax || l.latMin != r.latMin || l.latMax != r.latMax || l.lngMin != r.lngMin || l.lngMax != r.lngMax) {
+			lazyErrors++;
+		}
+	}
+	std::cout << "float errors: " << floatErrors << ", lazy errors: " << lazyErrors << std::endl;
+
+	// Coarse filter pass over each decoded result set, which is bound by memory bandwidth for the full ranges
+	auto scan = [&](const auto& results, auto latMin, const char* name, double decodeTime) {
+
+		std::chrono::steady_clock::time_point s0 = std::chrono::steady_clock::now();
+		size_t count = 0;
+		for (const auto& r : results) {
+			count += (latMin(r) > 0.5);
+		}
+		std::chrono::steady_clock::time_point s1 = std::chrono::steady_clock::now();
+
+		double scanTime = std::chrono::duration<double>(s1 - s0).count();
+		double bytes = (double)results.size() * sizeof(results[0]);
+		std::cout << name << ": " << sizeof(results[0]) << " bytes, decode " << decodeTime << " s, ";
+		std::cout << "scan " << scanTime << " s (" << bytes / scanTime / 1.0e9 << " GB/s, " << count << " matches)" << std::endl;
+	};
+
+	scan(ranges, [](const Range& r) { return r.latMin; }, "Range", std::chrono::duration<double>(t1 - t0).count());
+	scan(rangesF, [](const RangeF& r) { return r.latMin; }, "RangeF", std::chrono::duration<double>(t2 - t1).count());
+	scan(lazyRanges, [](const LazyRange& r) { return r.latMin(); }, "LazyRange", std::chrono::duration<double>(t3 - t2).count());
+}
+
+
+void Program::testCoverer(int n, int k) {
+
+	std::vector<Point> points = generateRandomPoints(n);
+
+	EfficientOperations efficient;
+	ModifiedEfficient efficientVol(1.7, 1.45);
+
+	SphericalCap cap(0.6, 0.7, 1500.0);
+	Cone cone(0.3, 0.4, 0.2, 3000.0, GRID_RAD);
+	ExtrudedPolygon polygon({ { 0.1, 0.1 }, { 0.2, 1.2 }, { 0.9, 0.8 }, { 1.1, 0.2 } }, 0.0, 700.0);
+
+	std::cout << "testing coverings of " << n << " points at k = " << k << std::endl;
+
+	for (const IndexOperations* io : { (const IndexOperations*)&efficient, (const IndexOperations*)&efficientVol }) {
+
+		RegionCoverer coverer(io, k, 5000, 0);
+
+		std::vector<IndexInterval> capIntervals = coverer.coverIntervals(cap);
+		std::vector<IndexInterval> coneIntervals = coverer.coverIntervals(cone);
+		std::vector<IndexInterval> polygonIntervals = coverer.coverIntervals(polygon);
+
+		std::cout << "cap misses: " << checkCovering(points, k, cap, capIntervals, io) << " (" << capIntervals.size() << " intervals)" << std::endl;
+		std::cout << "cone misses: " << checkCovering(points, k, cone, coneIntervals, io) << " (" << coneIntervals.size() << " intervals)" << std::endl;
+		std::cout << "polygon misses: " << checkCovering(points, k, polygon, polygonIntervals, io) << " (" << polygonIntervals.size() << " intervals)" << std::endl;
+	}
+}
+
+
+void Program::testPartitioner(int n, int k, int numShards) {
+
+	std::vector<Point> points = generateRandomPoints(n);
+	std::vector<Index> keys = generateIndicesFromPoints(points, k);
+
+	EfficientOperations efficient;
+	KeyPartitioner partitioner(numShards, std::max(k - 5, 0));
+	partitioner.build(points, k, &efficient, std::max(n / 100, numShards * 64), 1);
+
+	std::cout << "partitioning " << n << " keys at k = " << k << " into " << numShards << " shards" << std::endl;
+
+	// Routing must agree with a plain binary search over the splitters
+	const std::vector<Index>& splitters = partitioner.getSplitters();
+	int routeErrors = 0;
+	for (Index key : keys) {
+		int expected = (int)(std::upper_bound(splitters.begin(), splitters.end(), key) - splitters.begin());
+		if (partitioner.shardOf(key) != expected) {
+			routeErrors++;
+		}
+	}
+	std::cout << "routing errors: " << routeErrors << std::endl;
+
+	// Compare against splitting the key space evenly
+	std::vector<size_t> balanced = partitioner.simulate(keys);
+	std::vector<size_t> even(numShards, 0);
+	Index first = (Index)1 << (3 * k);
+	for (Index key : keys) {
+		even[std::min((size_t)((key - first) * (double)numShards / first), (size_t)numShards - 1)]++;
+	}
+
+	double mean = n / (double)numShards;
+	std::cout << "even split max / mean: " << *std::max_element(even.begin(), even.end()) / mean << std::endl;
+	std::cout << "balanced max / mean: " << *std::max_element(balanced.begin(), balanced.end()) / mean << std::endl;
+}
+
+
+void Program::testIncremental(int n, int steps, int k) {
+
+	std::vector<Point> points = generateRandomPoints(n, Distribution::VOLUME_UNIFORM);
+
+	std::mt19937_64 eng(nextSeed++);
+	std::normal_distribution<> normal(0.0, 1.0);
+
+	SimpleOperations simple;
+	EfficientOperations efficient;
+	ModifiedEfficient efficientVol(1.7, 1.45);
+	const IndexOperations* ops[] = {&simple, &efficient, &efficientVol};
+	const char* names[] = {"simple", "efficient", "efficientVol"};
+
+	std::cout << "tracking " << n << " objects for " << steps << " steps at k = " << k << std::endl;
+
+	for (int o = 0; o < 3; o++) {
+
+		IncrementalIndexer indexer(ops[o], k);
+		std::vector<Point> positions = points;
+		std::vector<TrackedCell> cells;
+		indexer.trackAll(positions, cells);
+
+		UpdateStats stats;
+		std::vector<size_t> changed;
+		double updateTime = 0.0;
+		double encodeTime = 0.0;
+		int errors = 0;
+
+		for (int s = 0; s < steps; s++) {
+
+			// Small random moves, about a tenth of a level 10 cell
+			for (Point& p : positions) {
+				p.rad = std::min(std::max(p.rad + 0.5 * normal(eng), 0.001), GRID_RAD);
+				p.lat = std::min(std::max(p.lat + 0.0002 * normal(eng), 0.0), M_PI_2 - 1e-9);
+				p.lng = std::min(std::max(p.lng + 0.0002 * normal(eng), 0.0), M_PI_2 - 1e-9);
+			}
+
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			UpdateStats step = indexer.updateAll(cells, positions, changed);
+			std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+			std::vector<Index> indices;
+			ops[o]->pointsToIndices(positions, k, indices);
+			std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+			updateTime += std::chrono::duration<double>(t1 - t0).count();
+			encodeTime += std::chrono::duration<double>(t2 - t1).count();
+			stats.unchanged += step.unchanged;
+			stats.neighbour += step.neighbour;
+			stats.reencoded += step.reencoded;
+
+			// Every tracked index must match encoding from scratch
+			for (size_t i = 0; i < cells.size(); i++) {
+				if (cells[i].index != indices[i]) {
+					errors++;
+				}
+			}
+		}
+
+		std::cout << names[o] << ": " << errors << " errors, ";
+		std::cout << stats.unchanged << " unchanged, " << stats.neighbour << " neighbour, " << stats.reencoded << " re-encoded, ";
+		std::cout << "update " << updateTime << " s vs encode " << encodeTime << " s" << std::endl;
+	}
+}
+
+
+void Program::testAdaptive(int n, int k, int maxPoints) {
+
+	std::vector<Point> points = generateRandomPoints(n, Distribution::CLUSTERED);
+	std::vector<Index> keys = generateIndicesFromPoints(points, k);
+	std::sort(keys.begin(), keys.end());
+
+	AdaptiveIndex index(maxPoints);
+	index.build(keys, k);
+
+	std::cout << "adaptive index of " << n << " clustered keys at k = " << k << ", at most " << maxPoints << " per leaf" << std::endl;
+
+	// Leaves must be in order, respect the limit and hold exactly the keys under their cell
+	int leafErrors = 0;
+	size_t total = 0;
+	Index previousEnd = 0;
+	for (size_t leaf = 0; leaf < index.numLeaves(); leaf++) {
+
+		int shift = 3 * (k - index.leafLevel(leaf));
+		Index first = index.leafCell(leaf) << shift;
+		if ((leaf > 0 && first <= previousEnd) || (index.leafSize(leaf) > (size_t)maxPoints && index.leafLevel(leaf) < k)) {
+			leafErrors++;
+		}
+		previousEnd = ((index.leafCell(leaf) + 1) << shift) - 1;
+		total += index.leafSize(leaf);
+	}
+	int findErrors = 0;
+	for (size_t i = 0; i < keys.size(); i++) {
+		size_t leaf = index.findLeaf(keys[i]);
+		if (leaf == index.numLeaves() || (keys[i] >> (3 * (k - index.leafLevel(leaf)))) != index.leafCell(leaf)) {
+			findErrors++;
+		}
+	}
+	std::cout << "leaf errors: " << leafErrors << ", find errors: " << findErrors << ", keys in leaves: " << total << std::endl;
+
+	std::vector<size_t> levels = index.levelCounts();
+	std::cout << "leaves: " << index.numLeaves() << " (";
+	for (int l = 0; l <= k; l++) {
+		if (levels[l] > 0) {
+			std::cout << " " << l << ":" << levels[l];
+		}
+	}
+	std::cout << " ), tree bytes: " << index.memoryBytes() << std::endl;
+
+	// Counts through a covering must match searching the whole key array
+	EfficientOperations efficient;
+	RegionCoverer coverer(&efficient, k, 5000);
+	SphericalCap cap(0.6, 0.7, 1500.0);
+	std::vector<IndexInterval> intervals = coverer.coverIntervals(cap);
+
+	size_t expected = 0;
+	for (const IndexInterval& interval : intervals) {
+		expected += std::upper_bound(keys.begin(), keys.end(), interval.second) - std::lower_bound(keys.begin(), keys.end(), interval.first);
+	}
+	std::cout << "cap count: " << index.count(intervals) << " expected " << expected << ", leaves touched: " << index.leavesIn(intervals).size() << std::endl;
+}
+
+
+void Program::testFieldStore(int n, int k) {
+
+	std::vector<Point> points = generateRandomPoints(n, Distribution::VOLUME_UNIFORM);
+
+	EfficientOperations efficient;
+	FieldStore dense(&efficient, k);
+	FieldStore sparse(&efficient, k);
+
+	// Field that is linear in the grid parameters, sampled at cell centres
+	auto field = [](const Point& p) { return p.rad / GRID_RAD + p.lat + 2.0 * p.lng; };
+
+	// Every valid cell at level k goes in the dense store and every other one in the sparse store
+	std::vector<Index> cells = { 1 };
+	for (int level = 0; level < k; level++) {
+		std::vector<Index> next;
+		for (Index cell : cells) {
+			Index children[8];
+			int numChildren = indexChildren(cell, children);
+			next.insert(next.end(), children, children + numChildren);
+		}
+		cells.swap(next);
+	}
+	for (Index cell : cells) {
+		Range r = efficient.indexToRange(cell);
+		double value = field(Point((r.radMin + r.radMax) / 2.0, (r.latMin + r.latMax) / 2.0, (r.lngMin + r.lngMax) / 2.0));
+		dense.set(cell, value);
+		if (cell % 2 == 0) {
+			sparse.set(cell, value);
+		}
+	}
+
+	std::cout << "sampling " << n << " points from " << dense.size() << " cells at k = " << k << " in " << dense.numBricks() << " bricks, ";
+	std::cout << dense.memoryBytes() << " bytes" << std::endl;
+
+	std::vector<double> nearest, interpolated;
+	std::vector<uint8_t> nearestFound, interpolatedFound;
+	dense.sampleNearest(points, nearest, nearestFound);
+	dense.sampleInterpolated(points, interpolated, interpolatedFound);
+
+	double nearestError = 0.0;
+	double interpolatedError = 0.0;
+	int missing = 0;
+	for (int i = 0; i < n; i++) {
+		if (!nearestFound[i] || !interpolatedFound[i]) {
+			missing++;
+			continue;
+		}
+		nearestError += fabs(nearest[i] - field(points[i]));
+		interpolatedError += fabs(interpolated[i] - field(points[i]));
+	}
+	std::cout << "missing: " << missing << ", mean error nearest: " << nearestError / n << ", interpolated: " << interpolatedError / n << std::endl;
+
+	// Samples from the sparse store must only be found where a cell with a value was available
+	std::vector<Index> indices = generateIndicesFromPoints(points, k);
+	sparse.sampleNearest(points, nearest, nearestFound);
+	sparse.sampleInterpolated(points, interpolated, interpolatedFound);
+
+	int sparseErrors = 0;
+	for (int i = 0; i < n; i++) {
+		if (nearestFound[i] != (indices[i] % 2 == 0) || (nearestFound[i] && !interpolatedFound[i]) || std::isnan(interpolated[i])) {
+			sparseErrors++;
+		}
+	}
+	std::cout << "sparse errors: " << sparseErrors << std::endl;
+}
+
+
+void Program::testRemap(int sourceLevel, int targetLevel) {
+
+	EfficientOperations efficient;
+	ModifiedEfficient efficientVol(1.7, 1.45);
+	const IndexOperations* targets[] = {&efficient, &efficientVol};
+	const char* names[] = {"efficient", "efficientVol"};
+
+	unsigned int numThreads = defaultThreadCount();
+
+	for (int o = 0; o < 2; o++) {
+
+		GridRemapper remapper(&efficient, targets[o], targetLevel);
+
+		// Each source cell's fractions must sum to 1, and the volume mapped into each target cell must add up to its volume
+		std::vector<std::unordered_map<Index, double>> targetVolumes(numThreads);
+		std::vector<uint64_t> sourceCounts(numThreads, 0);
+		std::vector<uint64_t> weightCounts(numThreads, 0);
+		std::vector<double> maxSumErrors(numThreads, 0.0);
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		remapper.remapAll(sourceLevel, [&](Index source, const std::vector<RemapWeight>& weights, unsigned int t) {
+
+			double sourceVolume = GridRemapper::volume(efficient.indexToRange(source));
+			double sum = 0.0;
+			for (const RemapWeight& w : weights) {
+				sum += w.fraction;
+				targetVolumes[t][w.target] += w.fraction * sourceVolume;
+			}
+			maxSumErrors[t] = std::max(maxSumErrors[t], fabs(sum - 1.0));
+			sourceCounts[t]++;
+			weightCounts[t] += weights.size();
+		}, numThreads);
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+		for (unsigned int t = 1; t < numThreads; t++) {
+			for (const std::pair<const Index, double>& v : targetVolumes[t]) {
+				targetVolumes[0][v.first] += v.second;
+			}
+		}
+		double maxVolumeError = 0.0;
+		for (const std::pair<const Index, double>& v : targetVolumes[0]) {
+			double expected = GridRemapper::volume(targets[o]->indexToRange(v.first));
+			maxVolumeError = std::max(maxVolumeError, fabs(v.second - expected) / expected);
+		}
+
+		uint64_t numSources = 0, numWeights = 0;
+		double maxSumError = 0.0;
+		for (unsigned int t = 0; t < numThreads; t++) {
+			numSources += sourceCounts[t];
+			numWeights += weightCounts[t];
+			maxSumError = std::max(maxSumError, maxSumErrors[t]);
+		}
+
+		std::cout << "efficient k = " << sourceLevel << " to " << names[o] << " k = " << targetLevel << ": ";
+		std::cout << numSources << " cells, " << numWeights / (double)numSources << " targets per cell, ";
+		std::cout << std::chrono::duration<double>(t1 - t0).count() << " s" << std::endl;
+		std::cout << "max fraction sum error: " << maxSumError << ", max target volume error: " << maxVolumeError << std::endl;
+	}
+}
+
+
+void Program::profileOperations(int n, int k) {
+
+	if (!Instrumentation::enabled()) {
+		std::cout << "instrumentation is not compiled in, define SDOG_INSTRUMENT" << std::endl;
+		return;
+	}
+
+	std::vector<Point> points = generateRandomPoints(n, Distribution::VOLUME_UNIFORM);
+
+	SimpleOperations simple;
+	EfficientOperations efficient;
+	ModifiedEfficient efficientVol(1.7, 1.45);
+	CachedOperations cached(&efficientVol, 16 << 20);
+
+	Instrumentation::reset();
+	for (const IndexOperations* io : { (const IndexOperations*)&simple, (const IndexOperations*)&efficient, (const IndexOperations*)&efficientVol, (const IndexOperations*)&cached }) {
+
+		std::vector<Index> indices;
+		std::vector<Range> ranges;
+		io->pointsToIndices(points, k, indices);
+		io->indicesToRanges(indices, ranges);
+	}
+
+	std::cout << "profile of " << n << " volume points at k = " << k << std::endl;
+	Instrumentation::snapshot().print(std::cout);
+}
+
+
 int Program::comparePointToIndex(const std::vector<Point>& points, int k, const IndexOperations* io1, const IndexOperations* io2, bool log) {
 
 	int errorCount = 0;
@@ -151,15 +655,42 @@ int Program::compareIndexToRange(const std::vector<Index>& indices, const IndexO
 }
 
 
-double Program::timePointToIndex(const std::vector<Point>& points, int k, const IndexOperations* io) {
-
-	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+// Counts points inside the region whose index is not in the covering
+int Program::checkCovering(const std::vector<Point>& points, int k, const Region& region, const std::vector<IndexInterval>& intervals, const IndexOperations* io) {
 
+	int missCount = 0;
 	for (const Point& p : points) {
+
+		// A degenerate range at the point is contained exactly when the point is inside the region
+		Range r(p.rad, p.rad, p.lat, p.lat, p.lng, p.lng);
+		if (region.relate(r) != RegionRelation::CONTAINS) {
+			continue;
+		}
+
 		Index i = io->pointToIndex(p, k);
+		auto it = std::upper_bound(intervals.begin(), intervals.end(), IndexInterval(i, ~(Index)0));
+		if (it == intervals.begin() || (--it)->second < i) {
+			missCount++;
+		}
+	}
+	return missCount;
+}
+
+
+double Program::timePointToIndex(const PointBuffer& points, int k, const IndexOperations* io) {
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+	Index checksum = 0;
+	for (size_t i = 0; i < points.size(); i++) {
+		checksum ^= io->pointToIndex(Point(points.rad[i], points.lat[i], points.lng[i]), k);
 	}
 
 	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+	// Use the results so the loop can't be optimized away
+	volatile Index sink = checksum;
+	(void)sink;
 	std::chrono::duration<double> dTimeS = std::chrono::duration_cast<std::chrono::duration<double>>(t1 - t0);
 
 	return dTimeS.count();
@@ -170,31 +701,27 @@ double Program::timeIndexToRange(const std::vector<Index>& indices, const IndexO
 	
 	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
 
+	double checksum = 0.0;
 	for (const Index& i : indices) {
 		Range r = io->indexToRange(i);
+		checksum += r.radMin + r.latMin + r.lngMin;
 	}
 
 	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+	// Use the results so the loop can't be optimized away
+	volatile double sink = checksum;
+	(void)sink;
 	std::chrono::duration<double> dTimeS = std::chrono::duration_cast<std::chrono::duration<double>>(t1 - t0);
 
 	return dTimeS.count();
 }
 
 
-std::vector<Point> Program::generateRandomPoints(int n) {
-
-	std::random_device rd;
-	std::mt19937 eng(rd());
+std::vector<Point> Program::generateRandomPoints(int n, Distribution distribution) {
 
-	std::uniform_real_distribution<> radDist(0.0, GRID_RAD);
-	std::uniform_real_distribution<> latLngDist(0.0, M_PI_2);
-
-	std::vector<Point> points;
-	for (int i = 0; i < n; i++) {
-		points.push_back(Point(radDist(eng), latLngDist(eng), latLngDist(eng)));
-	}
-
-	return points;
+	WorkloadGenerator generator(distribution, nextSeed++);
+	return generator.generate(n);
 }
 
 
@@ -208,9 +735,7 @@ std::vector<Index> Program::generateIndicesFromPoints(const std::vector<Point>&
 	std::vector<Index> indices;
 	EfficientOperations eo;
 
-	for (const Point& p : points) {
-		indices.push_back(eo.pointToIndex(p, k));
-	}
+	eo.pointsToIndices(points, k, indices);
 
 	return indices;
 }
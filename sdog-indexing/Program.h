@@ -1,24 +1,50 @@
 #pragma once
 
+#include "AdaptiveIndex.h"
+#include "CachedOperations.h"
+#include "DifferentialTester.h"
+#include "FieldStore.h"
+#include "GridRemapper.h"
+#include "IncrementalIndexer.h"
 #include "IndexOperations.h"
+#include "Instrumentation.h"
+#include "KeyPartitioner.h"
+#include "RegionCoverer.h"
+#include "Workload.h"
 
 #include <random>
+#include <string>
 
 
 class Program {
 
 public:
-	void testOperations(int n, int k);
-	void benchmarkAll(int n, int maxK);
+	void testOperations(int n, int k, Distribution distribution = Distribution::PARAMETER_UNIFORM);
+	void testDifferential(uint64_t n, int k, unsigned int numThreads);
+	void benchmarkAll(int n, int maxK, const std::string& fileName);
+	void benchmarkCache(int n, int k, size_t memoryBudget);
+	void testQuantized(int n, int k);
+	void benchmarkCompactRanges(int n, int k);
+	void testCoverer(int n, int k);
+	void testPartitioner(int n, int k, int numShards);
+	void testIncremental(int n, int steps, int k);
+	void testAdaptive(int n, int k, int maxPoints);
+	void testFieldStore(int n, int k);
+	void testRemap(int sourceLevel, int targetLevel);
+	void profileOperations(int n, int k);
 
 private:
 	int comparePointToIndex(const std::vector<Point>& points, int k, const IndexOperations* io1, const IndexOperations* io2, bool log);
 	int compareIndexToRange(const std::vector<Index>& indices, const IndexOperations* io1, const IndexOperations* io2, bool log);
+	int checkCovering(const std::vector<Point>& points, int k, const Region& region, const std::vector<IndexInterval>& intervals, const IndexOperations* io);
 
-	double timePointToIndex(const std::vector<Point>& points, int k, const IndexOperations* io);
+	double timePointToIndex(const PointBuffer& points, int k, const IndexOperations* io);
 	double timeIndexToRange(const std::vector<Index>& indices, const IndexOperations* io);
 
-	std::vector<Point> generateRandomPoints(int n);
+	// Each call uses the next seed so runs are reproducible but successive sets differ
+	uint64_t nextSeed = 1;
+
+	std::vector<Point> generateRandomPoints(int n, Distribution distribution = Distribution::PARAMETER_UNIFORM);
 	std::vector<Index> generateRandomIndices(int n, int k);
 	std::vector<Index> generateIndicesFromPoints(const std::vector<Point>& points, int k);
 };
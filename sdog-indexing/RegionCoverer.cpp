@@ -0,0 +1,292 @@
+#include "RegionCoverer.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// Frontiers smaller than this are classified on the calling thread
+constexpr size_t PARALLEL_THRESHOLD = 4096;
+
+// Deepest level that fits in an index
+constexpr int MAX_LEVEL = (INDEX_WIDTH - 1) / 3;
+
+
+// Great circle angle between two (lat, lng) positions
+static double angleBetween(double lat1, double lng1, double lat2, double lng2) {
+
+	double sLat = sin((lat2 - lat1) / 2.0);
+	double sLng = sin((lng2 - lng1) / 2.0);
+	double h = sLat * sLat + cos(lat1) * cos(lat2) * sLng * sLng;
+	return 2.0 * asin(std::min(1.0, sqrt(h)));
+}
+
+
+// Angle from a position to the meridian segment at edgeLng between latMin and latMax
+static double angleToMeridian(double lat, double lng, double edgeLng, double latMin, double latMax) {
+
+	// Position in a frame where the meridian plane is x-z
+	double dLng = lng - edgeLng;
+	double x = cos(lat) * cos(dLng);
+	double y = cos(lat) * sin(dLng);
+	double z = sin(lat);
+
+	// Closest point on the meridian's great circle is inside the segment
+	double closestLat = atan2(z, x);
+	if (closestLat >= latMin && closestLat <= latMax) {
+		return asin(std::min(1.0, fabs(y)));
+	}
+	return std::min(angleBetween(lat, lng, latMin, edgeLng), angleBetween(lat, lng, latMax, edgeLng));
+}
+
+
+// Smallest angle from a position to any point in the lat/lng bounds of a range
+static double minAngle(double lat, double lng, const Range& r) {
+
+	double lngMid = (r.lngMin + r.lngMax) / 2.0;
+	double dLng = remainder(lng - lngMid, 2.0 * M_PI);
+
+	// Closest point is on the same meridian
+	if (fabs(dLng) <= (r.lngMax - r.lngMin) / 2.0) {
+		return std::max({ 0.0, r.latMin - lat, lat - r.latMax });
+	}
+	// Otherwise it is on one of the bounding meridians
+	return std::min(angleToMeridian(lat, lng, r.lngMin, r.latMin, r.latMax),
+	                angleToMeridian(lat, lng, r.lngMax, r.latMin, r.latMax));
+}
+
+
+// Largest angle from a position to any point in the lat/lng bounds of a range
+static double maxAngle(double lat, double lng, const Range& r) {
+	return M_PI - minAngle(-lat, lng + M_PI, r);
+}
+
+
+SphericalCap::SphericalCap(double lat, double lng, double radius) :
+	lat(lat),
+	lng(lng),
+	radius(radius)
+{}
+
+
+RegionRelation SphericalCap::relate(const Range& r) const {
+
+	// Squared distance from the centre (on the surface) to a point at radius rad and angle a from the centre
+	auto dist2 = [](double rad, double a) {
+		return rad * rad + GRID_RAD * GRID_RAD - 2.0 * rad * GRID_RAD * cos(a);
+	};
+
+	// For a fixed angle distance is minimized at the foot of the perpendicular and grows with angle
+	double aMin = minAngle(lat, lng, r);
+	double radClosest = std::min(std::max(GRID_RAD * cos(aMin), r.radMin), r.radMax);
+	if (dist2(radClosest, aMin) > radius * radius) {
+		return RegionRelation::DISJOINT;
+	}
+
+	// Distance is convex in radius so the maximum is at one of the radial bounds
+	double aMax = maxAngle(lat, lng, r);
+	if (std::max(dist2(r.radMin, aMax), dist2(r.radMax, aMax)) <= radius * radius) {
+		return RegionRelation::CONTAINS;
+	}
+	return RegionRelation::INTERSECTS;
+}
+
+
+Cone::Cone(double lat, double lng, double halfAngle, double radMin, double radMax) :
+	lat(lat),
+	lng(lng),
+	halfAngle(halfAngle),
+	radMin(radMin),
+	radMax(radMax)
+{}
+
+
+RegionRelation Cone::relate(const Range& r) const {
+
+	if (r.radMax < radMin || r.radMin > radMax || minAngle(lat, lng, r) > halfAngle) {
+		return RegionRelation::DISJOINT;
+	}
+	if (r.radMin >= radMin && r.radMax <= radMax && maxAngle(lat, lng, r) <= halfAngle) {
+		return RegionRelation::CONTAINS;
+	}
+	return RegionRelation::INTERSECTS;
+}
+
+
+ExtrudedPolygon::ExtrudedPolygon(const std::vector<std::pair<double, double>>& vertices, double depthMin, double depthMax) :
+	vertices(vertices),
+	radMin(GRID_RAD - depthMax),
+	radMax(GRID_RAD - depthMin)
+{}
+
+
+RegionRelation ExtrudedPolygon::relate(const Range& r) const {
+
+	if (vertices.size() < 3 || r.radMax < radMin || r.radMin > radMax) {
+		return RegionRelation::DISJOINT;
+	}
+
+	for (size_t i = 0; i < vertices.size(); i++) {
+		if (edgeIntersects(i, r)) {
+			return RegionRelation::INTERSECTS;
+		}
+	}
+
+	// No edge touches the bounds so the cell is either entirely inside or entirely outside the polygon
+	if (!contains((r.latMin + r.latMax) / 2.0, (r.lngMin + r.lngMax) / 2.0)) {
+		return RegionRelation::DISJOINT;
+	}
+	if (r.radMin >= radMin && r.radMax <= radMax) {
+		return RegionRelation::CONTAINS;
+	}
+	return RegionRelation::INTERSECTS;
+}
+
+
+// Even-odd point in polygon test
+bool ExtrudedPolygon::contains(double lat, double lng) const {
+
+	bool inside = false;
+	for (size_t i = 0, j = vertices.size() - 1; i < vertices.size(); j = i++) {
+
+		const std::pair<double, double>& a = vertices[i];
+		const std::pair<double, double>& b = vertices[j];
+
+		if ((a.first > lat) != (b.first > lat)) {
+			double crossLng = a.second + (lat - a.first) / (b.first - a.first) * (b.second - a.second);
+			if (lng < crossLng) {
+				inside = !inside;
+			}
+		}
+	}
+	return inside;
+}
+
+
+// Liang-Barsky clip of edge i against the lat/lng bounds of a range
+bool ExtrudedPolygon::edgeIntersects(size_t i, const Range& r) const {
+
+	const std::pair<double, double>& a = vertices[i];
+	const std::pair<double, double>& b = vertices[(i + 1) % vertices.size()];
+
+	double dLat = b.first - a.first;
+	double dLng = b.second - a.second;
+
+	double p[4] = { -dLat, dLat, -dLng, dLng };
+	double q[4] = { a.first - r.latMin, r.latMax - a.first, a.second - r.lngMin, r.lngMax - a.second };
+
+	double t0 = 0.0;
+	double t1 = 1.0;
+	for (int j = 0; j < 4; j++) {
+
+		if (p[j] == 0.0) {
+			if (q[j] < 0.0) {
+				return false;
+			}
+		}
+		else {
+			double t = q[j] / p[j];
+			if (p[j] < 0.0) {
+				t0 = std::max(t0, t);
+			}
+			else {
+				t1 = std::min(t1, t);
+			}
+			if (t0 > t1) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+RegionCoverer::RegionCoverer(const IndexOperations* io, int maxLevel, int maxCells, unsigned int numThreads) :
+	io(io),
+	maxLevel(maxLevel),
+	maxCells(maxCells),
+	numThreads(numThreads)
+{}
+
+
+std::vector<Index> RegionCoverer::cover(const Region& region) const {
+
+	std::vector<Index> result;
+	std::vector<Index> frontier = { 1 };
+	std::vector<RegionRelation> relations;
+
+	for (int level = 0; !frontier.empty(); level++) {
+
+		// Classify all cells at this level
+		relations.resize(frontier.size());
+		unsigned int threads = (frontier.size() < PARALLEL_THRESHOLD) ? 1 : numThreads;
+		parallelFor(frontier.size(), threads, [&](size_t begin, size_t end, unsigned int) {
+			for (size_t i = begin; i < end; i++) {
+				relations[i] = region.relate(io->indexToRange(frontier[i]));
+			}
+		});
+
+		// Accept contained cells and collect children of partially covered ones
+		std::vector<Index> partial;
+		std::vector<Index> next;
+		for (size_t i = 0; i < frontier.size(); i++) {
+
+			if (relations[i] == RegionRelation::CONTAINS) {
+				result.push_back(frontier[i]);
+			}
+			else if (relations[i] == RegionRelation::INTERSECTS) {
+				partial.push_back(frontier[i]);
+
+				Index children[8];
+				int numChildren = indexChildren(frontier[i], children);
+				next.insert(next.end(), children, children + numChildren);
+			}
+		}
+
+		// Stop refining if the budget would be exceeded
+		if (level == maxLevel || result.size() + next.size() > (size_t)maxCells) {
+			result.insert(result.end(), partial.begin(), partial.end());
+			break;
+		}
+		frontier.swap(next);
+	}
+
+	// Order cells of different levels along the curve
+	std::sort(result.begin(), result.end(), [](Index a, Index b) {
+		return (a << (3 * (MAX_LEVEL - indexLevel(a)))) < (b << (3 * (MAX_LEVEL - indexLevel(b))));
+	});
+	return result;
+}
+
+
+std::vector<IndexInterval> RegionCoverer::coverIntervals(const Region& region) const {
+	return cellsToIntervals(cover(region), maxLevel);
+}
+
+
+std::vector<IndexInterval> RegionCoverer::cellsToIntervals(const std::vector<Index>& cells, int k) {
+
+	std::vector<IndexInterval> intervals;
+	for (Index cell : cells) {
+
+		int shift = 3 * (k - indexLevel(cell));
+		if (shift < 0) {
+			continue;
+		}
+		intervals.push_back(IndexInterval(cell << shift, ((cell + 1) << shift) - 1));
+	}
+	std::sort(intervals.begin(), intervals.end());
+
+	// Merge touching intervals
+	std::vector<IndexInterval> merged;
+	for (const IndexInterval& i : intervals) {
+		if (!merged.empty() && i.first <= merged.back().second + 1) {
+			merged.back().second = std::max(merged.back().second, i.second);
+		}
+		else {
+			merged.push_back(i);
+		}
+	}
+	return merged;
+}
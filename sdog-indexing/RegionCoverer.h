@@ -0,0 +1,95 @@
+#pragma once
+
+#include "IndexOperations.h"
+
+#include <utility>
+#include <vector>
+
+
+// Inclusive range of indices at a single refinement level
+typedef std::pair<Index, Index> IndexInterval;
+
+
+enum class RegionRelation {
+	DISJOINT,
+	INTERSECTS,
+	CONTAINS
+};
+
+
+// Volume that can be tested against SDOG cell bounds. Angles are in radians and radii in km, the same as Point
+class Region {
+
+public:
+	// Must be conservative: only return DISJOINT or CONTAINS when it is certain
+	virtual RegionRelation relate(const Range& r) const = 0;
+};
+
+
+// Solid sphere of a given radius (km) around a point on the surface, clipped to the grid
+class SphericalCap : public Region {
+
+public:
+	SphericalCap(double lat, double lng, double radius);
+
+	RegionRelation relate(const Range& r) const;
+
+private:
+	double lat, lng;
+	double radius;
+};
+
+
+// Cone with its apex at the centre of the Earth, limited to a radial interval
+class Cone : public Region {
+
+public:
+	Cone(double lat, double lng, double halfAngle, double radMin = 0.0, double radMax = GRID_RAD);
+
+	RegionRelation relate(const Range& r) const;
+
+private:
+	double lat, lng;
+	double halfAngle;
+	double radMin, radMax;
+};
+
+
+// Polygon with (lat, lng) vertices extruded over a depth interval (km below the surface).
+// Edges are straight lines in lat/lng space.
+class ExtrudedPolygon : public Region {
+
+public:
+	ExtrudedPolygon(const std::vector<std::pair<double, double>>& vertices, double depthMin, double depthMax);
+
+	RegionRelation relate(const Range& r) const;
+
+private:
+	std::vector<std::pair<double, double>> vertices;
+	double radMin, radMax;
+
+	bool contains(double lat, double lng) const;
+	bool edgeIntersects(size_t i, const Range& r) const;
+};
+
+
+// Approximates a region with SDOG cells by refining from the root cell. Cells fully inside the region
+// are accepted without refinement, cells crossing the boundary are refined until maxLevel or until
+// refining would produce more than maxCells cells.
+class RegionCoverer {
+
+public:
+	RegionCoverer(const IndexOperations* io, int maxLevel, int maxCells, unsigned int numThreads = 1);
+
+	std::vector<Index> cover(const Region& region) const;
+	std::vector<IndexInterval> coverIntervals(const Region& region) const;
+
+	// Converts cells (of any level) into sorted, merged intervals at level k
+	static std::vector<IndexInterval> cellsToIntervals(const std::vector<Index>& cells, int k);
+
+private:
+	const IndexOperations* io;
+	int maxLevel;
+	int maxCells;
+	unsigned int numThreads;
+};
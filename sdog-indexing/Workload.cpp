@@ -0,0 +1,193 @@
+#include "Workload.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+
+// Mixes a seed and stream number into a well distributed engine seed
+static uint64_t splitMix(uint64_t seed, uint64_t stream) {
+
+	uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+
+// Folds a value back into [0, max] by reflecting at the ends
+static double reflect(double v, double max) {
+
+	v = fmod(fabs(v), 2.0 * max);
+	return (v > max) ? 2.0 * max - v : v;
+}
+
+
+void PointBuffer::resize(size_t n) {
+	rad.resize(n);
+	lat.resize(n);
+	lng.resize(n);
+}
+
+
+std::vector<Point> PointBuffer::toPoints() const {
+
+	std::vector<Point> points(size());
+	for (size_t i = 0; i < size(); i++) {
+		points[i] = (*this)[i];
+	}
+	return points;
+}
+
+
+WorkloadGenerator::WorkloadGenerator(Distribution distribution, uint64_t seed, unsigned int numThreads) :
+	distribution(distribution),
+	seed(seed),
+	numThreads(numThreads)
+{}
+
+
+void WorkloadGenerator::generate(size_t n, PointBuffer& buffer) const {
+
+	buffer.resize(n);
+	size_t numBlocks = (n + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	// Cluster centres are shared by all blocks
+	std::vector<Point> centres;
+	if (distribution == Distribution::CLUSTERED) {
+		centres = clusterCentres();
+	}
+
+	parallelFor(numBlocks, numThreads, [&](size_t begin, size_t end, unsigned int) {
+		for (size_t b = begin; b < end; b++) {
+			generateBlock(b, b * BLOCK_SIZE, std::min(n, (b + 1) * BLOCK_SIZE), centres, buffer);
+		}
+	});
+}
+
+
+std::vector<Point> WorkloadGenerator::generate(size_t n) const {
+
+	PointBuffer buffer;
+	generate(n, buffer);
+	return buffer.toPoints();
+}
+
+
+std::vector<Point> WorkloadGenerator::clusterCentres() const {
+
+	std::mt19937_64 eng(splitMix(seed, ~0ull));
+	std::uniform_real_distribution<> unit(0.0, 1.0);
+
+	// At least one centre, so blocks always have a cluster to draw from
+	std::vector<Point> centres;
+	for (int c = 0; c < std::max(numClusters, 1); c++) {
+		double depth = 700.0 * unit(eng);
+		centres.push_back(Point(GRID_RAD - depth, asin(unit(eng)), M_PI_2 * unit(eng)));
+	}
+	return centres;
+}
+
+
+void WorkloadGenerator::generateBlock(size_t block, size_t begin, size_t end, const std::vector<Point>& centres, PointBuffer& buffer) const {
+
+	std::mt19937_64 eng(splitMix(seed, block));
+	std::uniform_real_distribution<> unit(0.0, 1.0);
+	std::normal_distribution<> normal(0.0, 1.0);
+
+	// Area uniform latitude and volume uniform radius
+	auto areaLat = [&]() { return asin(unit(eng)); };
+	auto volumeRad = [&]() { return GRID_RAD * cbrt(unit(eng)); };
+	auto surfaceRad = [&]() { return GRID_RAD - std::min(-surfaceDepth * log(1.0 - unit(eng)), GRID_RAD); };
+
+	if (distribution == Distribution::CLUSTERED) {
+
+		std::uniform_int_distribution<size_t> clusterDist(0, centres.size() - 1);
+
+		for (size_t i = begin; i < end; i++) {
+			const Point& c = centres[clusterDist(eng)];
+			buffer.rad[i] = reflect(c.rad + clusterDepth * normal(eng), GRID_RAD);
+			buffer.lat[i] = reflect(c.lat + clusterAngle * normal(eng), M_PI_2);
+			buffer.lng[i] = reflect(c.lng + clusterAngle * normal(eng), M_PI_2);
+		}
+		return;
+	}
+
+	if (distribution == Distribution::TRAJECTORY) {
+
+		// One track per block starting near the surface
+		double rad = surfaceRad();
+		double lat = areaLat();
+		double lng = M_PI_2 * unit(eng);
+		double heading = 2.0 * M_PI * unit(eng);
+
+		for (size_t i = begin; i < end; i++) {
+			buffer.rad[i] = rad;
+			buffer.lat[i] = lat;
+			buffer.lng[i] = lng;
+
+			heading += 0.1 * normal(eng);
+			rad = reflect(rad + 0.1 * normal(eng), GRID_RAD);
+			lat = reflect(lat + trajectoryStep * cos(heading), M_PI_2);
+			lng = reflect(lng + trajectoryStep * sin(heading) / std::max(cos(lat), 0.01), M_PI_2);
+		}
+		return;
+	}
+
+	for (size_t i = begin; i < end; i++) {
+
+		if (distribution == Distribution::PARAMETER_UNIFORM) {
+			buffer.rad[i] = GRID_RAD * unit(eng);
+			buffer.lat[i] = M_PI_2 * unit(eng);
+		}
+		else if (distribution == Distribution::VOLUME_UNIFORM) {
+			buffer.rad[i] = volumeRad();
+			buffer.lat[i] = areaLat();
+		}
+		else if (distribution == Distribution::SURFACE_SHELL) {
+			buffer.rad[i] = surfaceRad();
+			buffer.lat[i] = areaLat();
+		}
+		else {// distribution == Distribution::POLAR
+			buffer.rad[i] = volumeRad();
+			buffer.lat[i] = M_PI_2 - std::min(-polarScale * log(1.0 - unit(eng)), M_PI_2);
+		}
+		buffer.lng[i] = M_PI_2 * unit(eng);
+	}
+}
+
+
+bool WorkloadGenerator::parseDistribution(const std::string& name, Distribution& distribution) {
+
+	const Distribution all[] = {
+		Distribution::PARAMETER_UNIFORM,
+		Distribution::VOLUME_UNIFORM,
+		Distribution::SURFACE_SHELL,
+		Distribution::POLAR,
+		Distribution::CLUSTERED,
+		Distribution::TRAJECTORY
+	};
+	for (Distribution d : all) {
+		if (name == distributionName(d)) {
+			distribution = d;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+const char* WorkloadGenerator::distributionName(Distribution distribution) {
+
+	switch (distribution) {
+	case Distribution::PARAMETER_UNIFORM: return "parameter";
+	case Distribution::VOLUME_UNIFORM: return "volume";
+	case Distribution::SURFACE_SHELL: return "surface";
+	case Distribution::POLAR: return "polar";
+	case Distribution::CLUSTERED: return "clustered";
+	case Distribution::TRAJECTORY: return "trajectory";
+	}
+	return "";
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "IndexOperations.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+enum class Distribution {
+	PARAMETER_UNIFORM, // uniform in (rad, lat, lng), the original test distribution
+	VOLUME_UNIFORM,    // uniform by volume
+	SURFACE_SHELL,     // exponentially distributed depth below the surface
+	POLAR,             // concentrated around the pole
+	CLUSTERED,         // Gaussian clusters around random centres
+	TRAJECTORY         // random walk tracks, consecutive points follow each other
+};
+
+
+// Structure of arrays point storage
+struct PointBuffer {
+	std::vector<double> rad;
+	std::vector<double> lat;
+	std::vector<double> lng;
+
+	size_t size() const { return rad.size(); }
+	void resize(size_t n);
+
+	Point operator[](size_t i) const { return Point(rad[i], lat[i], lng[i]); }
+	std::vector<Point> toPoints() const;
+};
+
+
+// Seeded point generator. Points are produced in fixed size blocks, each with its own engine seeded
+// from the generator seed and block number, so output only depends on the seed and not on threads.
+class WorkloadGenerator {
+
+public:
+	WorkloadGenerator(Distribution distribution, uint64_t seed, unsigned int numThreads = 0);
+
+	void generate(size_t n, PointBuffer& buffer) const;
+	std::vector<Point> generate(size_t n) const;
+
+	static bool parseDistribution(const std::string& name, Distribution& distribution);
+	static const char* distributionName(Distribution distribution);
+
+	// Shape parameters, angles in radians and distances in km
+	double surfaceDepth = 35.0;   // mean depth for SURFACE_SHELL
+	double polarScale = 0.05;     // mean angle from the pole for POLAR
+	int numClusters = 32;         // values below 1 are treated as 1
+	double clusterAngle = 0.02;   // standard deviation of cluster spread
+	double clusterDepth = 50.0;
+	double trajectoryStep = 0.001; // angle moved per point along a track
+
+	static constexpr size_t BLOCK_SIZE = 4096; // points per block, and per track for TRAJECTORY
+
+private:
+	Distribution distribution;
+	uint64_t seed;
+	unsigned int numThreads;
+
+	// Seeded from the generator seed alone, so every block sees the same centres
+	std::vector<Point> clusterCentres() const;
+	void generateBlock(size_t block, size_t begin, size_t end, const std::vector<Point>& centres, PointBuffer& buffer) const;
+};
@@ -3,7 +3,7 @@
 int main(int argc, char* argv[]) {
 	Program p;
 	p.testOperations(1000000, 15);
-	//p.benchmarkAll(1000000, 21);
+	//p.benchmarkAll(1000000, 21, "1mil-run2.csv");
 	//system("pause");
 	return 0;
 }
\ No newline at end of file